@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "blockimage.h"
+
+uint32_t blockimage_block_count(uint64_t imageSize, uint32_t blockSize) {
+    return (uint32_t) ((imageSize + blockSize - 1) / blockSize);
+}
+
+uint32_t blockimage_block_size(uint64_t imageSize, uint32_t blockSize, uint32_t block) {
+    uint64_t remaining = imageSize - (uint64_t) block * blockSize;
+    return remaining < blockSize ? (uint32_t) remaining : blockSize;
+}
+
+static int blockimage_is_zero(const uint8_t* block, uint32_t size) {
+    for(uint32_t i = 0; i < size; i++) {
+        if(block[i] != 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+uint32_t blockimage_pack(const uint8_t* block, uint32_t size, void* workspace, const uint8_t** packed) {
+    *packed = block;
+
+    if(blockimage_is_zero(block, size)) {
+        return 0;
+    }
+
+    uint8_t* compressed = (uint8_t*) workspace + LZ4_WORKSPACE_SIZE;
+
+    // Only keep the compressed form when it is strictly smaller.
+    uint32_t compressedSize = size > 1 ? lz4_compress(block, size, compressed, size - 1, workspace) : 0;
+    if(compressedSize == 0) {
+        return size;
+    }
+
+    *packed = compressed;
+    return compressedSize;
+}
+
+int blockimage_unpack(const uint8_t* packed, uint32_t packedSize, uint8_t* block, uint32_t size) {
+    if(packedSize == 0) {
+        memset(block, 0, size);
+        return 0;
+    }
+
+    if(packedSize == size) {
+        memcpy(block, packed, size);
+        return 0;
+    }
+
+    if(packedSize > size) {
+        return -1;
+    }
+
+    return lz4_decompress(packed, packedSize, block, size) == (int32_t) size ? 0 : -1;
+}
+
+int blockimage_expand(FILE* in, FILE* out) {
+    blockimage_header header;
+    if(fseek(in, 0, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, in) != 1
+       || header.magic != BLOCKIMAGE_MAGIC || header.version != BLOCKIMAGE_VERSION
+       || header.blockSize == 0 || header.blockSize > BLOCKIMAGE_BLOCK_SIZE_MAX
+       || header.blockCount != blockimage_block_count(header.imageSize, header.blockSize)) {
+        return -1;
+    }
+
+    int res = -1;
+
+    blockimage_entry* index = (blockimage_entry*) calloc(header.blockCount + 1, sizeof(blockimage_entry));
+    uint8_t* packed = (uint8_t*) malloc(header.blockSize);
+    uint8_t* block = (uint8_t*) malloc(header.blockSize);
+
+    if(index != NULL && packed != NULL && block != NULL
+       && fseek(in, (long) header.indexOffset, SEEK_SET) == 0
+       && fread(index, sizeof(blockimage_entry), header.blockCount, in) == header.blockCount) {
+        res = 0;
+
+        for(uint32_t i = 0; i < header.blockCount && res == 0; i++) {
+            uint32_t size = blockimage_block_size(header.imageSize, header.blockSize, i);
+
+            if(index[i].size > size
+               || (index[i].size > 0 && (fseek(in, (long) index[i].offset, SEEK_SET) != 0 || fread(packed, 1, index[i].size, in) != index[i].size))
+               || blockimage_unpack(packed, index[i].size, block, size) != 0
+               || fwrite(block, 1, size, out) != size) {
+                res = -1;
+            }
+        }
+    }
+
+    free(block);
+    free(packed);
+    free(index);
+
+    return res;
+}
+
+int blockimage_apply_delta(FILE* delta, FILE* image) {
+    blockimage_delta_header header;
+    if(fseek(delta, 0, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, delta) != 1
+       || header.magic != BLOCKIMAGE_DELTA_MAGIC || header.version != BLOCKIMAGE_VERSION
+       || header.blockSize == 0 || header.blockSize > BLOCKIMAGE_BLOCK_SIZE_MAX) {
+        return -1;
+    }
+
+    uint32_t blockCount = blockimage_block_count(header.imageSize, header.blockSize);
+
+    uint8_t* packed = (uint8_t*) malloc(header.blockSize);
+    uint8_t* block = (uint8_t*) malloc(header.blockSize);
+
+    int res = packed != NULL && block != NULL ? 0 : -1;
+
+    for(uint32_t i = 0; i < header.recordCount && res == 0; i++) {
+        blockimage_delta_record record;
+        if(fread(&record, sizeof(record), 1, delta) != 1 || record.block >= blockCount) {
+            res = -1;
+            break;
+        }
+
+        uint32_t size = blockimage_block_size(header.imageSize, header.blockSize, record.block);
+
+        if(record.size > size
+           || fread(packed, 1, record.size, delta) != record.size
+           || blockimage_unpack(packed, record.size, block, size) != 0
+           || fseek(image, (long) ((uint64_t) record.block * header.blockSize), SEEK_SET) != 0
+           || fwrite(block, 1, size, image) != size) {
+            res = -1;
+        }
+    }
+
+    free(block);
+    free(packed);
+
+    return res;
+}
\ No newline at end of file
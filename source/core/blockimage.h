@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "lz4.h"
+
+// Block-indexed image: a header, the packed blocks back to back, then an
+// index with one entry per block. Everything is little-endian. Blocks are
+// packed independently, so any one of them can be restored on its own.
+
+#define BLOCKIMAGE_MAGIC 0x5A494246 // "FBIZ"
+#define BLOCKIMAGE_VERSION 1
+
+#define BLOCKIMAGE_BLOCK_SIZE (1024 * 256)
+#define BLOCKIMAGE_BLOCK_SIZE_MAX (1024 * 1024 * 16)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t blockSize;
+    uint32_t blockCount;
+    uint64_t imageSize;
+    uint64_t indexOffset;
+} blockimage_header;
+
+// A packed size of 0 is an all-zero block, the block's full size is a block
+// stored as-is, and anything in between is LZ4-compressed.
+typedef struct {
+    uint64_t offset;
+    uint32_t size;
+    uint32_t reserved;
+} blockimage_entry;
+
+// Incremental dumps keep a manifest with the SHA-256 of every block of the
+// last dump, and write each dump as a delta holding only the blocks that
+// changed since. The first delta of a chain holds every block, so applying
+// deltas 0 through the manifest's generation in order over an empty file
+// rebuilds the latest image.
+
+#define BLOCKIMAGE_MANIFEST_MAGIC 0x4D494246 // "FBIM"
+#define BLOCKIMAGE_DELTA_MAGIC 0x44494246 // "FBID"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t blockSize;
+    uint32_t blockCount;
+    uint64_t imageSize;
+    uint32_t generation;
+    uint32_t reserved;
+} blockimage_manifest_header;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t blockSize;
+    uint32_t recordCount;
+    uint64_t imageSize;
+    uint32_t generation;
+    uint32_t reserved;
+} blockimage_delta_header;
+
+// Followed by size bytes of the block, packed as by blockimage_pack.
+typedef struct {
+    uint32_t block;
+    uint32_t size;
+} blockimage_delta_record;
+
+// Size of the workspace blockimage_pack needs.
+#define BLOCKIMAGE_WORKSPACE_SIZE(blockSize) ((blockSize) + LZ4_WORKSPACE_SIZE)
+
+uint32_t blockimage_block_count(uint64_t imageSize, uint32_t blockSize);
+
+// Packs one block of size bytes. *packed is pointed at the bytes to store,
+// either block itself or a buffer inside workspace, and their size returned.
+uint32_t blockimage_pack(const uint8_t* block, uint32_t size, void* workspace, const uint8_t** packed);
+
+// Restores a block of size bytes from its packed form. Returns 0 on success.
+int blockimage_unpack(const uint8_t* packed, uint32_t packedSize, uint8_t* block, uint32_t size);
+
+// Size of the given block; only the last one may be short.
+uint32_t blockimage_block_size(uint64_t imageSize, uint32_t blockSize, uint32_t block);
+
+// Expands a whole image back to its raw form. Returns 0 on success.
+int blockimage_expand(FILE* in, FILE* out);
+
+// Writes the blocks of one delta into a raw image. Returns 0 on success.
+int blockimage_apply_delta(FILE* delta, FILE* image);
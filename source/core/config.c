@@ -0,0 +1,135 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <3ds.h>
+
+#include "config.h"
+#include "util.h"
+
+#define CONFIG_FILE_MAX 0x4000
+
+typedef struct {
+    char key[CONFIG_KEY_MAX];
+    char value[CONFIG_VALUE_MAX];
+} config_entry;
+
+static config_entry entries[CONFIG_ENTRIES_MAX];
+static u32 entryCount = 0;
+
+static char* config_trim(char* str) {
+    while(isspace((unsigned char) *str)) {
+        str++;
+    }
+
+    char* end = str + strlen(str);
+    while(end > str && isspace((unsigned char) end[-1])) {
+        end--;
+    }
+
+    *end = '\0';
+    return str;
+}
+
+static void config_parse_line(char* line) {
+    char* comment = strchr(line, '#');
+    if(comment != NULL) {
+        *comment = '\0';
+    }
+
+    char* separator = strchr(line, '=');
+    if(separator == NULL || entryCount >= CONFIG_ENTRIES_MAX) {
+        return;
+    }
+
+    *separator = '\0';
+
+    char* key = config_trim(line);
+    char* value = config_trim(separator + 1);
+    if(*key == '\0' || *value == '\0') {
+        return;
+    }
+
+    config_entry* entry = &entries[entryCount++];
+    strncpy(entry->key, key, CONFIG_KEY_MAX - 1);
+    strncpy(entry->value, value, CONFIG_VALUE_MAX - 1);
+}
+
+void config_init() {
+    entryCount = 0;
+    memset(entries, 0, sizeof(entries));
+
+    FS_Path* fsPath = util_make_path_utf8(CONFIG_PATH);
+    if(fsPath == NULL) {
+        return;
+    }
+
+    Handle fileHandle = 0;
+    if(R_SUCCEEDED(FSUSER_OpenFileDirectly(&fileHandle, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, ""), *fsPath, FS_OPEN_READ, 0))) {
+        char* text = (char*) calloc(1, CONFIG_FILE_MAX + 1);
+        if(text != NULL) {
+            u32 bytesRead = 0;
+            if(R_SUCCEEDED(FSFILE_Read(fileHandle, &bytesRead, 0, text, CONFIG_FILE_MAX))) {
+                text[bytesRead] = '\0';
+
+                char* line = text;
+                while(line != NULL) {
+                    char* next = strpbrk(line, "\r\n");
+                    if(next != NULL) {
+                        *next++ = '\0';
+                    }
+
+                    config_parse_line(line);
+                    line = next;
+                }
+            }
+
+            free(text);
+        }
+
+        FSFILE_Close(fileHandle);
+    }
+
+    util_free_path_utf8(fsPath);
+}
+
+const char* config_get_string(const char* key, const char* defaultValue) {
+    // Later lines override earlier ones.
+    for(u32 i = entryCount; i > 0; i--) {
+        if(strcmp(entries[i - 1].key, key) == 0) {
+            return entries[i - 1].value;
+        }
+    }
+
+    return defaultValue;
+}
+
+u32 config_get_u32(const char* key, u32 defaultValue) {
+    const char* value = config_get_string(key, NULL);
+    if(value == NULL) {
+        return defaultValue;
+    }
+
+    char* end = NULL;
+    unsigned long result = strtoul(value, &end, 0);
+
+    return end != value && *end == '\0' ? (u32) result : defaultValue;
+}
+
+bool config_get_bool(const char* key, bool defaultValue) {
+    const char* value = config_get_string(key, NULL);
+    if(value == NULL) {
+        return defaultValue;
+    }
+
+    if(strcmp(value, "1") == 0 || strcasecmp(value, "true") == 0 || strcasecmp(value, "yes") == 0) {
+        return true;
+    }
+
+    if(strcmp(value, "0") == 0 || strcasecmp(value, "false") == 0 || strcasecmp(value, "no") == 0) {
+        return false;
+    }
+
+    return defaultValue;
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#pragma once
+
+#define CONFIG_PATH "/fbi/config.txt"
+
+#define CONFIG_ENTRIES_MAX 32
+#define CONFIG_KEY_MAX 32
+#define CONFIG_VALUE_MAX 256
+
+// Reads key = value lines from CONFIG_PATH; '#' starts a comment. A missing
+// file leaves every setting at its default.
+void config_init();
+
+const char* config_get_string(const char* key, const char* defaultValue);
+u32 config_get_u32(const char* key, u32 defaultValue);
+bool config_get_bool(const char* key, bool defaultValue);
\ No newline at end of file
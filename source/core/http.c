@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <3ds.h>
+
+#include "http.h"
+#include "../ui/error.h"
+
+static Result http_stream_begin(http_stream* stream) {
+    Result res = 0;
+
+    for(u32 redirects = 0; redirects <= HTTP_REDIRECTS_MAX; redirects++) {
+        if(R_FAILED(res = httpcOpenContext(&stream->context, HTTPC_METHOD_GET, stream->url, 1))) {
+            return res;
+        }
+
+        httpcSetSSLOpt(&stream->context, SSLCOPT_DisableVerify);
+
+        if(stream->offset > 0) {
+            char range[32];
+            snprintf(range, sizeof(range), "bytes=%llu-", (unsigned long long) stream->offset);
+            httpcAddRequestHeaderField(&stream->context, "Range", range);
+
+            // Only resume the same version of the resource.
+            if(stream->etag[0] != '\0') {
+                httpcAddRequestHeaderField(&stream->context, "If-Range", stream->etag);
+            }
+        }
+
+        if(R_SUCCEEDED(res = httpcBeginRequest(&stream->context)) && R_SUCCEEDED(res = httpcGetResponseStatusCode(&stream->context, &stream->responseCode, 0))) {
+            u32 code = stream->responseCode;
+            if(code == 301 || code == 302 || code == 303 || code == 307 || code == 308) {
+                if(R_SUCCEEDED(res = httpcGetResponseHeader(&stream->context, "Location", stream->url, HTTP_URL_MAX))) {
+                    httpcCloseContext(&stream->context);
+                    continue;
+                }
+            } else if(code != (stream->offset > 0 ? 206 : 200)) {
+                res = R_FBI_HTTP_RESPONSE_CODE;
+            }
+        }
+
+        if(R_FAILED(res)) {
+            httpcCloseContext(&stream->context);
+        } else {
+            stream->open = true;
+        }
+
+        return res;
+    }
+
+    return R_FBI_HTTP_RESPONSE_CODE;
+}
+
+Result http_stream_open(http_stream* stream, const char* url) {
+    memset(stream, 0, sizeof(http_stream));
+    strncpy(stream->url, url, HTTP_URL_MAX - 1);
+
+    Result res = 0;
+    if(R_SUCCEEDED(res = http_stream_begin(stream))) {
+        u32 downloadSize = 0;
+        if(R_SUCCEEDED(res = httpcGetDownloadSizeState(&stream->context, NULL, &downloadSize))) {
+            stream->size = downloadSize;
+
+            char acceptRanges[16];
+            stream->ranges = R_SUCCEEDED(httpcGetResponseHeader(&stream->context, "Accept-Ranges", acceptRanges, sizeof(acceptRanges)))
+                             && strncmp(acceptRanges, "bytes", 5) == 0;
+
+            if(R_FAILED(httpcGetResponseHeader(&stream->context, "ETag", stream->etag, HTTP_ETAG_MAX))) {
+                stream->etag[0] = '\0';
+            }
+        } else {
+            http_stream_close(stream);
+        }
+    }
+
+    return res;
+}
+
+Result http_stream_close(http_stream* stream) {
+    Result res = 0;
+
+    if(stream->open) {
+        res = httpcCloseContext(&stream->context);
+        stream->open = false;
+    }
+
+    return res;
+}
+
+Result http_stream_get_size(http_stream* stream, u64* size) {
+    *size = stream->size;
+    return 0;
+}
+
+Result http_stream_read(http_stream* stream, u32* bytesRead, void* buffer, u32 size) {
+    *bytesRead = 0;
+
+    Result res = 0;
+    if(stream->open) {
+        res = httpcDownloadData(&stream->context, buffer, size, bytesRead);
+        stream->offset += *bytesRead;
+
+        if(res == HTTPC_RESULTCODE_DOWNLOADPENDING || R_SUCCEEDED(res)) {
+            if(*bytesRead > 0) {
+                stream->retries = 0;
+            }
+
+            return 0;
+        }
+
+        http_stream_close(stream);
+    }
+
+    if(!stream->ranges || stream->offset >= stream->size || stream->retries >= HTTP_RETRIES_MAX) {
+        return R_FAILED(res) ? res : R_FBI_HTTP_RESPONSE_CODE;
+    }
+
+    // Back off a little more each time, in case the link is recovering.
+    stream->retries++;
+    svcSleepThread(500000000ULL * stream->retries);
+
+    // A 200 to a ranged request means the resource changed under If-Range or
+    // the server ignored the range; asking again only gets the same answer.
+    if((res = http_stream_begin(stream)) == R_FBI_HTTP_RESPONSE_CODE && stream->responseCode == 200) {
+        stream->ranges = false;
+        return res;
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+
+#define HTTP_URL_MAX 1024
+#define HTTP_ETAG_MAX 0x80
+#define HTTP_REDIRECTS_MAX 5
+#define HTTP_RETRIES_MAX 5
+
+// A GET download that, when the server accepts byte ranges, reconnects at
+// the last byte read after a failed read rather than failing.
+typedef struct http_stream_s {
+    httpcContext context;
+    bool open;
+
+    char url[HTTP_URL_MAX];
+    char etag[HTTP_ETAG_MAX];
+    u32 responseCode;
+
+    bool ranges;
+    u64 size;
+    u64 offset;
+    u32 retries;
+} http_stream;
+
+// Follows redirects; url is left holding the final location.
+Result http_stream_open(http_stream* stream, const char* url);
+Result http_stream_close(http_stream* stream);
+
+Result http_stream_get_size(http_stream* stream, u64* size);
+
+// Returns 0 bytes while reconnecting; call again to continue.
+Result http_stream_read(http_stream* stream, u32* bytesRead, void* buffer, u32 size);
\ No newline at end of file
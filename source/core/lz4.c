@@ -0,0 +1,195 @@
+#include <string.h>
+
+#include "lz4.h"
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MF_LIMIT 12
+#define LZ4_MAX_OFFSET 65535
+
+#define LZ4_SKIP_TRIGGER 6
+
+static uint32_t lz4_read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t lz4_hash(uint32_t value) {
+    return (value * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+static uint8_t* lz4_write_length(uint8_t* op, uint32_t length) {
+    while(length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+
+    *op++ = (uint8_t) length;
+    return op;
+}
+
+static uint8_t* lz4_write_literals(uint8_t* op, const uint8_t* literals, uint32_t length, uint8_t** token) {
+    *token = op++;
+    **token = (uint8_t) ((length >= 15 ? 15 : length) << 4);
+
+    if(length >= 15) {
+        op = lz4_write_length(op, length - 15);
+    }
+
+    memcpy(op, literals, length);
+    return op + length;
+}
+
+uint32_t lz4_compress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstCapacity, void* workspace) {
+    uint32_t* table = (uint32_t*) workspace;
+    memset(table, 0, LZ4_WORKSPACE_SIZE);
+
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* end = src + srcSize;
+
+    uint8_t* op = dst;
+    uint8_t* opEnd = dst + dstCapacity;
+
+    if(srcSize > LZ4_MF_LIMIT) {
+        const uint8_t* mfLimit = end - LZ4_MF_LIMIT;
+        const uint8_t* matchLimit = end - LZ4_LAST_LITERALS;
+
+        // Step further ahead the longer no match turns up, so incompressible
+        // data is skipped over quickly.
+        uint32_t searches = 1 << LZ4_SKIP_TRIGGER;
+
+        while(ip < mfLimit) {
+            uint32_t sequence = lz4_read32(ip);
+            uint32_t hash = lz4_hash(sequence);
+
+            const uint8_t* ref = src + table[hash];
+            table[hash] = (uint32_t) (ip - src);
+
+            if(ref >= ip || ip - ref > LZ4_MAX_OFFSET || lz4_read32(ref) != sequence) {
+                ip += searches++ >> LZ4_SKIP_TRIGGER;
+                continue;
+            }
+
+            searches = 1 << LZ4_SKIP_TRIGGER;
+
+            while(ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+
+            const uint8_t* matchEnd = ip + LZ4_MIN_MATCH;
+            const uint8_t* refEnd = ref + LZ4_MIN_MATCH;
+            while(matchEnd < matchLimit && *matchEnd == *refEnd) {
+                matchEnd++;
+                refEnd++;
+            }
+
+            uint32_t literalLength = (uint32_t) (ip - anchor);
+            uint32_t matchLength = (uint32_t) (matchEnd - ip) - LZ4_MIN_MATCH;
+
+            if((uint32_t) (opEnd - op) < 1 + literalLength / 255 + 1 + literalLength + 2 + matchLength / 255 + 1) {
+                return 0;
+            }
+
+            uint8_t* token = NULL;
+            op = lz4_write_literals(op, anchor, literalLength, &token);
+
+            uint32_t offset = (uint32_t) (ip - ref);
+            *op++ = (uint8_t) (offset & 0xFF);
+            *op++ = (uint8_t) (offset >> 8);
+
+            *token |= (uint8_t) (matchLength >= 15 ? 15 : matchLength);
+            if(matchLength >= 15) {
+                op = lz4_write_length(op, matchLength - 15);
+            }
+
+            ip = matchEnd;
+            anchor = ip;
+        }
+    }
+
+    uint32_t literalLength = (uint32_t) (end - anchor);
+    if((uint32_t) (opEnd - op) < 1 + literalLength / 255 + 1 + literalLength) {
+        return 0;
+    }
+
+    uint8_t* token = NULL;
+    op = lz4_write_literals(op, anchor, literalLength, &token);
+
+    return (uint32_t) (op - dst);
+}
+
+static const uint8_t* lz4_read_length(const uint8_t* ip, const uint8_t* ipEnd, uint32_t* length) {
+    uint8_t next = 0;
+    do {
+        if(ip >= ipEnd) {
+            return NULL;
+        }
+
+        next = *ip++;
+        *length += next;
+    } while(next == 255);
+
+    return ip;
+}
+
+int32_t lz4_decompress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstCapacity) {
+    const uint8_t* ip = src;
+    const uint8_t* ipEnd = src + srcSize;
+
+    uint8_t* op = dst;
+    uint8_t* opEnd = dst + dstCapacity;
+
+    while(ip < ipEnd) {
+        uint8_t token = *ip++;
+
+        uint32_t literalLength = token >> 4;
+        if(literalLength == 15 && (ip = lz4_read_length(ip, ipEnd, &literalLength)) == NULL) {
+            return -1;
+        }
+
+        if(literalLength > (uint32_t) (ipEnd - ip) || literalLength > (uint32_t) (opEnd - op)) {
+            return -1;
+        }
+
+        memcpy(op, ip, literalLength);
+        op += literalLength;
+        ip += literalLength;
+
+        // The last sequence is literals only.
+        if(ip == ipEnd) {
+            break;
+        }
+
+        if(ipEnd - ip < 2) {
+            return -1;
+        }
+
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        if(offset == 0 || offset > (uint32_t) (op - dst)) {
+            return -1;
+        }
+
+        uint32_t matchLength = token & 15;
+        if(matchLength == 15 && (ip = lz4_read_length(ip, ipEnd, &matchLength)) == NULL) {
+            return -1;
+        }
+
+        matchLength += LZ4_MIN_MATCH;
+        if(matchLength > (uint32_t) (opEnd - op)) {
+            return -1;
+        }
+
+        // Byte by byte, since a match may overlap the bytes it produces.
+        const uint8_t* ref = op - offset;
+        while(matchLength-- > 0) {
+            *op++ = *ref++;
+        }
+    }
+
+    return (int32_t) (op - dst);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+// Worst-case size of a compressed block, for sizing output buffers.
+#define LZ4_COMPRESS_BOUND(size) ((size) + (size) / 255 + 16)
+
+#define LZ4_HASH_LOG 12
+#define LZ4_WORKSPACE_SIZE (sizeof(uint32_t) << LZ4_HASH_LOG)
+
+// Compresses src into the LZ4 block format. workspace must hold
+// LZ4_WORKSPACE_SIZE bytes. Returns the compressed size, or 0 if the result
+// does not fit in dstCapacity.
+uint32_t lz4_compress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstCapacity, void* workspace);
+
+// Expands an LZ4 block. Returns the expanded size, or -1 if the block is
+// malformed or does not fit in dstCapacity.
+int32_t lz4_decompress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstCapacity);
@@ -0,0 +1,145 @@
+#include <string.h>
+
+#include "sha256.h"
+
+static const uint32_t sha256K[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+#define SHA256_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_transform(sha256_context* ctx, const uint8_t* block) {
+    uint32_t w[64];
+    for(uint32_t i = 0; i < 16; i++) {
+        w[i] = ((uint32_t) block[i * 4] << 24) | ((uint32_t) block[i * 4 + 1] << 16) | ((uint32_t) block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+
+    for(uint32_t i = 16; i < 64; i++) {
+        uint32_t s0 = SHA256_ROTR(w[i - 15], 7) ^ SHA256_ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = SHA256_ROTR(w[i - 2], 17) ^ SHA256_ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = ctx->state[0];
+    uint32_t b = ctx->state[1];
+    uint32_t c = ctx->state[2];
+    uint32_t d = ctx->state[3];
+    uint32_t e = ctx->state[4];
+    uint32_t f = ctx->state[5];
+    uint32_t g = ctx->state[6];
+    uint32_t h = ctx->state[7];
+
+    for(uint32_t i = 0; i < 64; i++) {
+        uint32_t s1 = SHA256_ROTR(e, 6) ^ SHA256_ROTR(e, 11) ^ SHA256_ROTR(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + sha256K[i] + w[i];
+        uint32_t s0 = SHA256_ROTR(a, 2) ^ SHA256_ROTR(a, 13) ^ SHA256_ROTR(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+    ctx->state[5] += f;
+    ctx->state[6] += g;
+    ctx->state[7] += h;
+}
+
+void sha256_init(sha256_context* ctx) {
+    ctx->state[0] = 0x6A09E667;
+    ctx->state[1] = 0xBB67AE85;
+    ctx->state[2] = 0x3C6EF372;
+    ctx->state[3] = 0xA54FF53A;
+    ctx->state[4] = 0x510E527F;
+    ctx->state[5] = 0x9B05688C;
+    ctx->state[6] = 0x1F83D9AB;
+    ctx->state[7] = 0x5BE0CD19;
+
+    ctx->length = 0;
+    ctx->bufferFill = 0;
+}
+
+void sha256_update(sha256_context* ctx, const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*) data;
+
+    ctx->length += size;
+
+    if(ctx->bufferFill > 0) {
+        size_t fill = SHA256_BLOCK_SIZE - ctx->bufferFill;
+        if(fill > size) {
+            fill = size;
+        }
+
+        memcpy(ctx->buffer + ctx->bufferFill, bytes, fill);
+        ctx->bufferFill += fill;
+        bytes += fill;
+        size -= fill;
+
+        if(ctx->bufferFill < SHA256_BLOCK_SIZE) {
+            return;
+        }
+
+        sha256_transform(ctx, ctx->buffer);
+        ctx->bufferFill = 0;
+    }
+
+    while(size >= SHA256_BLOCK_SIZE) {
+        sha256_transform(ctx, bytes);
+        bytes += SHA256_BLOCK_SIZE;
+        size -= SHA256_BLOCK_SIZE;
+    }
+
+    memcpy(ctx->buffer, bytes, size);
+    ctx->bufferFill = size;
+}
+
+void sha256_final(sha256_context* ctx, uint8_t* digest) {
+    uint64_t bits = ctx->length * 8;
+
+    ctx->buffer[ctx->bufferFill++] = 0x80;
+    if(ctx->bufferFill > SHA256_BLOCK_SIZE - 8) {
+        memset(ctx->buffer + ctx->bufferFill, 0, SHA256_BLOCK_SIZE - ctx->bufferFill);
+        sha256_transform(ctx, ctx->buffer);
+        ctx->bufferFill = 0;
+    }
+
+    memset(ctx->buffer + ctx->bufferFill, 0, SHA256_BLOCK_SIZE - 8 - ctx->bufferFill);
+    for(uint32_t i = 0; i < 8; i++) {
+        ctx->buffer[SHA256_BLOCK_SIZE - 1 - i] = (uint8_t) (bits >> (i * 8));
+    }
+
+    sha256_transform(ctx, ctx->buffer);
+
+    for(uint32_t i = 0; i < 8; i++) {
+        digest[i * 4] = (uint8_t) (ctx->state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t) (ctx->state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t) (ctx->state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t) ctx->state[i];
+    }
+}
+
+void sha256(const void* data, size_t size, uint8_t* digest) {
+    sha256_context ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, size);
+    sha256_final(&ctx, digest);
+}
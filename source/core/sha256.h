@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_BLOCK_SIZE 64
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+    uint8_t buffer[SHA256_BLOCK_SIZE];
+    uint32_t bufferFill;
+} sha256_context;
+
+void sha256_init(sha256_context* ctx);
+void sha256_update(sha256_context* ctx, const void* data, size_t size);
+void sha256_final(sha256_context* ctx, uint8_t* digest);
+
+void sha256(const void* data, size_t size, uint8_t* digest);
@@ -57,4 +57,6 @@ u64 util_get_cia_title_id(u8* cia);
 u64 util_get_ticket_title_id(u8* ticket);
 u64 util_get_tmd_title_id(u8* tmd);
 u16 util_get_tmd_content_count(u8* tmd);
-u8* util_get_tmd_content_chunk(u8* tmd, u32 index);
\ No newline at end of file
+u8* util_get_tmd_content_chunk(u8* tmd, u32 index);
+
+u32 util_crc32(u32 crc, const void* data, u32 size);
\ No newline at end of file
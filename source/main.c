@@ -2,6 +2,7 @@
 
 #include <3ds.h>
 
+#include "core/config.h"
 #include "core/screen.h"
 #include "core/util.h"
 #include "svchax/svchax.h"
@@ -69,6 +70,8 @@ int main(int argc, const char* argv[]) {
         socInit(soc_buffer, 0x100000);
     }
 
+    config_init();
+
     screen_init();
     ui_init();
     task_init();
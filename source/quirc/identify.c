@@ -19,6 +19,10 @@
 #include <math.h>
 #include "quirc_internal.h"
 
+#if defined(__ARM_FEATURE_DSP)
+#include <arm_acle.h>
+#endif
+
 /************************************************************************
  * Linear algebra routines
  */
@@ -118,115 +122,183 @@ static void perspective_unmap(const double *c,
 }
 
 /************************************************************************
- * Span-based floodfill routine
+ * Run-length encoded rows
  */
 
-typedef struct fill_queue_node_s {
-	int x;
-	int y;
-
-	struct fill_queue_node_s* prev;
-	struct fill_queue_node_s* next;
-} fill_queue_node;
-
-typedef struct {
-	fill_queue_node* last;
-} fill_queue;
+/* Thresholding also records each row as runs of white and black pixels,
+ * as the x just past the end of each run. Runs alternate starting with
+ * white (the first may be empty) and the last ends at w. A row's runs are
+ * written from the end of its slot, so they start at run_start[y].
+ */
+static inline const uint16_t *row_runs(const struct quirc *q, int y, int *n)
+{
+	int start = q->run_start[y];
 
-static void fill_queue_init(fill_queue* queue) {
-	queue->last = NULL;
+	*n = q->w + 1 - start;
+	return q->runs + y * (q->w + 1) + start;
 }
 
-static int fill_queue_is_empty(fill_queue* queue) {
-	return queue->last == NULL;
-}
+/* Index of the run containing x. */
+static int run_find(const uint16_t *runs, int n, int x)
+{
+	int lo = 0;
+	int hi = n - 1;
 
-static void fill_queue_push(fill_queue* queue, int x, int y) {
-	fill_queue_node* node = (fill_queue_node*) calloc(1, sizeof(fill_queue_node));
-	if(node == NULL) {
-		return;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (runs[mid] <= x)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
-	node->x = x;
-	node->y = y;
-	node->next = NULL;
+	return lo;
+}
+
+/************************************************************************
+ * Span-based floodfill routine
+ */
 
-	if(queue->last == NULL) {
-		node->prev = NULL;
+/* Seeds are kept on a stack owned by the recognizer and grown on demand,
+ * so filling allocates nothing once it has reached its working size. If
+ * the stack cannot grow, the seed is dropped and the image is rescanned
+ * for unfilled neighbours once the stack has drained.
+ */
+static int fill_stack_push(struct quirc *q, int *top, int x, int y)
+{
+	if (*top >= q->fill_stack_size) {
+		int new_size = q->fill_stack_size * 2;
+		struct quirc_point *new_stack =
+			realloc(q->fill_stack, new_size * sizeof(*new_stack));
 
-		queue->last = node;
-	} else {
-		node->prev = queue->last;
+		if (!new_stack)
+			return -1;
 
-		queue->last->next = node;
-		queue->last = node;
+		q->fill_stack = new_stack;
+		q->fill_stack_size = new_size;
 	}
+
+	q->fill_stack[*top].x = x;
+	q->fill_stack[*top].y = y;
+	(*top)++;
+
+	return 0;
 }
 
-static void fill_queue_pop(fill_queue* queue, int* x, int* y) {
-	fill_queue_node* node = queue->last;
-	if(node != NULL) {
-		queue->last = node->prev;
+static int fill_rescan(const struct quirc *q, int from, int to,
+		       int *seed_x, int *seed_y)
+{
+	int x, y;
+
+	for (y = 0; y < q->h; y++) {
+		const uint8_t *row = q->image + y * q->w;
 
-		*x = node->x;
-		*y = node->y;
+		for (x = 0; x < q->w; x++) {
+			if (row[x] != from)
+				continue;
 
-		free(node);
+			if ((x > 0 && row[x - 1] == to) ||
+			    (x < q->w - 1 && row[x + 1] == to) ||
+			    (y > 0 && row[x - q->w] == to) ||
+			    (y < q->h - 1 && row[x + q->w] == to)) {
+				*seed_x = x;
+				*seed_y = y;
+				return 1;
+			}
+		}
 	}
+
+	return 0;
 }
 
 typedef void (*span_func_t)(void *user_data, int y, int left, int right);
 
+/* Pushes one seed per black run in the given row that overlaps left to
+ * right and still holds from-pixels, at its leftmost pixel in that range.
+ * Every pixel of a run belongs to the same region, so one pixel tells.
+ * Runs are pushed right to left, so they are filled in the same order as
+ * seeding every pixel would.
+ */
+static int flood_fill_push_runs(struct quirc *q, int *top, int y,
+				int left, int right, int from)
+{
+	const uint8_t *row = q->image + y * q->w;
+	int n;
+	const uint16_t *runs = row_runs(q, y, &n);
+	int failed = 0;
+	int k;
+
+	for (k = run_find(runs, n, right); k >= 0; k--) {
+		int start = k ? runs[k - 1] : 0;
+		int seed = start > left ? start : left;
+
+		if (runs[k] <= left)
+			break;
+
+		if ((k & 1) && row[seed] == from &&
+		    fill_stack_push(q, top, seed, y) < 0)
+			failed = 1;
+	}
+
+	return failed;
+}
+
 static void flood_fill_seed(struct quirc *q, int x, int y, int from, int to,
 			    span_func_t func, void *user_data,
 			    int depth)
 {
-	fill_queue queue;
-	fill_queue_init(&queue);
-	fill_queue_push(&queue, x, y);
+	int top = 0;
+	int overflow = 0;
 
-	while(!fill_queue_is_empty(&queue)) {
-		int currX = 0;
-		int currY = 0;
-		fill_queue_pop(&queue, &currX, &currY);
+	fill_stack_push(q, &top, x, y);
 
-		int left = currX;
-		int right = currX;
-		int i;
-		uint8_t *row = q->image + currY * q->w;
+	for (;;) {
+		while (top > 0) {
+			int currX, currY;
+			int left, right;
+			int i, k, n;
+			const uint16_t *runs;
+			uint8_t *row;
 
-		if(row[currX] == to)
-			continue;
+			top--;
+			currX = q->fill_stack[top].x;
+			currY = q->fill_stack[top].y;
 
-		while (left > 0 && row[left - 1] == from)
-			left--;
+			row = q->image + currY * q->w;
+			if (row[currX] == to)
+				continue;
 
-		while (right < q->w - 1 && row[right + 1] == from)
-			right++;
+			/* The span is the black run holding the seed */
+			runs = row_runs(q, currY, &n);
+			k = run_find(runs, n, currX);
+			left = k ? runs[k - 1] : 0;
+			right = runs[k] - 1;
 
-		/* Fill the extent */
-		for (i = left; i <= right; i++)
-			row[i] = to;
+			/* Fill the extent */
+			for (i = left; i <= right; i++)
+				row[i] = to;
 
-		if (func)
-			func(user_data, currY, left, right);
+			if (func)
+				func(user_data, currY, left, right);
 
-		/* Seed new flood-fills */
-		if (currY < q->h - 1) {
-			row = q->image + (currY + 1) * q->w;
+			/* Seed new flood-fills */
+			if (currY < q->h - 1)
+				overflow |= flood_fill_push_runs(q, &top,
+					currY + 1, left, right, from);
 
-			for (i = right; i >= left; i--)
-				if (row[i] == from)
-					fill_queue_push(&queue, i, currY + 1);
+			if (currY > 0)
+				overflow |= flood_fill_push_runs(q, &top,
+					currY - 1, left, right, from);
 		}
 
-		if (currY > 0) {
-			row = q->image + (currY - 1) * q->w;
+		/* Once a seed has been dropped, keep rescanning until no
+		 * unfilled neighbours are left.
+		 */
+		if (!overflow || !fill_rescan(q, from, to, &x, &y))
+			break;
 
-			for (i = right; i >= left; i--)
-				if (row[i] == from)
-					fill_queue_push(&queue, i, currY - 1);
-		}
+		fill_stack_push(q, &top, x, y);
 	}
 }
 
@@ -237,47 +309,224 @@ static void flood_fill_seed(struct quirc *q, int x, int y, int from, int to,
 #define THRESHOLD_S_DEN		8
 #define THRESHOLD_T		5
 
+/* Moving averages run in both directions along each row, alternating
+ * between rows, and carry over from one row to the next. The decay
+ * (avg * (s - 1)) / s is done with a reciprocal multiply, which gives
+ * the same result as the division for s < 256 (images up to 2047
+ * pixels wide).
+ */
+struct threshold_state {
+	uint32_t	s;
+	uint32_t	recip;
+	uint32_t	avg_w;
+	uint32_t	avg_u;
+
+	/* Window thresholded; the rest of the image is left white */
+	int		x0, y0;
+	int		x1, y1;
+};
+
+static void threshold_init(const struct quirc *q, struct threshold_state *t)
+{
+	t->s = q->w / THRESHOLD_S_DEN;
+	if (t->s < 1)
+		t->s = 1;
+
+	t->recip = t->s > 1 && t->s < 256 ?
+		(uint32_t)(0x100000000ULL / t->s) + 1 : 0;
+	t->avg_w = 0;
+	t->avg_u = 0;
+
+	if (q->roi_w > 0 && q->roi_h > 0) {
+		t->x0 = q->roi_x;
+		t->y0 = q->roi_y;
+		t->x1 = q->roi_x + q->roi_w;
+		t->y1 = q->roi_y + q->roi_h;
+	} else {
+		t->x0 = 0;
+		t->y0 = 0;
+		t->x1 = q->w;
+		t->y1 = q->h;
+	}
+}
+
+/* A row outside the window is a single white run. */
+static void threshold_row_blank(struct quirc *q, int y, uint8_t *row)
+{
+	memset(row, QUIRC_PIXEL_WHITE, q->w);
+
+	q->runs[y * (q->w + 1) + q->w] = q->w;
+	q->run_start[y] = q->w;
+}
+
+static inline uint32_t threshold_decay(const struct threshold_state *t,
+				       uint32_t avg)
+{
+	uint32_t n = avg * (t->s - 1);
+
+	if (t->recip)
+		return ((uint64_t)n * t->recip) >> 32;
+
+	return n / t->s;
+}
+
+/* Runs the right-to-left average over a row whose left-to-right average
+ * is already in row_average, and binarizes each pixel as it goes,
+ * recording the row's runs. A pixel is black when it is below
+ * (100 - T)% of the mean of the two averages, i.e.
+ * row[x] < avg * (100 - T) / (200 * s).
+ */
+static void threshold_row_finish(struct quirc *q, struct threshold_state *t,
+				 int y, uint8_t *row, uint32_t *avg_back)
+{
+	uint32_t *row_average = q->row_average;
+	uint16_t *runs = q->runs + y * (q->w + 1);
+	int start = q->w + 1;
+	uint32_t scale = 200 * t->s;
+	uint32_t avg = *avg_back;
+	int last_color = -1;
+	int x;
+
+	/* White right of the window */
+	if (t->x1 < q->w) {
+		memset(row + t->x1, QUIRC_PIXEL_WHITE, q->w - t->x1);
+		runs[--start] = q->w;
+		last_color = QUIRC_PIXEL_WHITE;
+	}
+
+	for (x = t->x1 - 1; x >= t->x0; x--) {
+		int color;
+
+		avg = threshold_decay(t, avg) + row[x];
+
+		color = (row[x] + 1) * scale <=
+			(row_average[x] + avg) * (100 - THRESHOLD_T) ?
+			QUIRC_PIXEL_BLACK : QUIRC_PIXEL_WHITE;
+		row[x] = color;
+
+		if (color != last_color) {
+			runs[--start] = x + 1;
+			last_color = color;
+		}
+	}
+
+	/* White left of the window; runs start with white */
+	memset(row, QUIRC_PIXEL_WHITE, t->x0);
+	if (last_color == QUIRC_PIXEL_BLACK)
+		runs[--start] = t->x0;
+
+	q->run_start[y] = start;
+	*avg_back = avg;
+}
+
 static void threshold(struct quirc *q)
 {
-	int x, y;
-	int avg_w = 0;
-	int avg_u = 0;
-	int threshold_s = q->w / THRESHOLD_S_DEN;
+	struct threshold_state t;
 	uint8_t *row = q->image;
+	int x, y;
+
+	threshold_init(q, &t);
 
 	for (y = 0; y < q->h; y++) {
-		int row_average[q->w];
+		uint32_t *avg_fwd = (y & 1) ? &t.avg_w : &t.avg_u;
+		uint32_t *avg_back = (y & 1) ? &t.avg_u : &t.avg_w;
+		uint32_t avg = *avg_fwd;
+
+		if (y < t.y0 || y >= t.y1) {
+			threshold_row_blank(q, y, row);
+			row += q->w;
+			continue;
+		}
 
-		memset(row_average, 0, sizeof(row_average));
+		for (x = t.x0; x < t.x1; x++) {
+			avg = threshold_decay(&t, avg) + row[x];
+			q->row_average[x] = avg;
+		}
 
-		for (x = 0; x < q->w; x++) {
-			int w, u;
-
-			if (y & 1) {
-				w = x;
-				u = q->w - 1 - x;
-			} else {
-				w = q->w - 1 - x;
-				u = x;
-			}
+		*avg_fwd = avg;
+
+		threshold_row_finish(q, &t, y, row, avg_back);
+		row += q->w;
+	}
+}
+
+/* Gray is (r8 + g8 + b8) / 3 over the 565 channels shifted up to eight
+ * bits; the division is a multiply by 2^16 / 3, exact for sums below
+ * 2^15. Pixels are converted two at a time, one per halfword.
+ */
+#define LUMA_DIV3	0x5556
+
+static inline uint32_t rgb565_luma_sum2(uint32_t px)
+{
+	uint32_t r = (px >> 11) & 0x001F001F;
+	uint32_t g = (px >> 5) & 0x003F003F;
+	uint32_t b = px & 0x001F001F;
+
+	return ((r + b) << 3) + (g << 2);
+}
+
+static inline uint8_t rgb565_luma(uint16_t px)
+{
+	return (rgb565_luma_sum2(px) * LUMA_DIV3) >> 16;
+}
+
+static void threshold_rgb565(struct quirc *q, const uint16_t *pixels,
+			     int stride)
+{
+	struct threshold_state t;
+	uint8_t *row = q->image;
+	int x, y;
 
-			avg_w = (avg_w * (threshold_s - 1)) /
-				threshold_s + row[w];
-			avg_u = (avg_u * (threshold_s - 1)) /
-				threshold_s + row[u];
+	threshold_init(q, &t);
 
-			row_average[w] += avg_w;
-			row_average[u] += avg_u;
+	for (y = 0; y < q->h; y++) {
+		const uint16_t *src = pixels + y * stride;
+		uint32_t *avg_fwd = (y & 1) ? &t.avg_w : &t.avg_u;
+		uint32_t *avg_back = (y & 1) ? &t.avg_u : &t.avg_w;
+		uint32_t avg = *avg_fwd;
+
+		if (y < t.y0 || y >= t.y1) {
+			threshold_row_blank(q, y, row);
+			row += q->w;
+			continue;
 		}
 
-		for (x = 0; x < q->w; x++) {
-			if (row[x] < row_average[x] *
-			    (100 - THRESHOLD_T) / (200 * threshold_s))
-				row[x] = QUIRC_PIXEL_BLACK;
-			else
-				row[x] = QUIRC_PIXEL_WHITE;
+		x = t.x0;
+
+		if (!((uintptr_t)(src + x) & 3)) {
+			for (; x + 1 < t.x1; x += 2) {
+				uint32_t px;
+				uint32_t sum;
+
+				memcpy(&px, src + x, sizeof(px));
+				sum = rgb565_luma_sum2(px);
+#if defined(__ARM_FEATURE_DSP)
+				uint8_t lo = __smulbb(sum, LUMA_DIV3) >> 16;
+				uint8_t hi = __smultb(sum, LUMA_DIV3) >> 16;
+#else
+				uint8_t lo = ((sum & 0xFFFF) * LUMA_DIV3) >> 16;
+				uint8_t hi = ((sum >> 16) * LUMA_DIV3) >> 16;
+#endif
+
+				row[x] = lo;
+				avg = threshold_decay(&t, avg) + lo;
+				q->row_average[x] = avg;
+
+				row[x + 1] = hi;
+				avg = threshold_decay(&t, avg) + hi;
+				q->row_average[x + 1] = avg;
+			}
+		}
+
+		for (; x < t.x1; x++) {
+			row[x] = rgb565_luma(src[x]);
+			avg = threshold_decay(&t, avg) + row[x];
+			q->row_average[x] = avg;
 		}
 
+		*avg_fwd = avg;
+
+		threshold_row_finish(q, &t, y, row, avg_back);
 		row += q->w;
 	}
 }
@@ -475,44 +724,42 @@ static void test_capstone(struct quirc *q, int x, int y, int *pb)
 
 static void finder_scan(struct quirc *q, int y)
 {
-	uint8_t *row = q->image + y * q->w;
-	int x;
-	int last_color;
-	int run_length = 0;
+	int n;
+	const uint16_t *runs = row_runs(q, y, &n);
 	int run_count = 0;
 	int pb[5];
+	int k;
 
 	memset(pb, 0, sizeof(pb));
-	for (x = 0; x < q->w; x++) {
-		int color = row[x] ? 1 : 0;
-
-		if (x && color != last_color) {
-			memmove(pb, pb + 1, sizeof(pb[0]) * 4);
-			pb[4] = run_length;
-			run_length = 0;
-			run_count++;
-
-			if (!color && run_count >= 5) {
-				static int check[5] = {1, 1, 3, 1, 1};
-				int avg, err;
-				int i;
-				int ok = 1;
-
-				avg = (pb[0] + pb[1] + pb[3] + pb[4]) / 4;
-				err = avg * 3 / 4;
 
-				for (i = 0; i < 5; i++)
-					if (pb[i] < check[i] * avg - err ||
-					    pb[i] > check[i] * avg + err)
-						ok = 0;
-
-				if (ok)
-					test_capstone(q, x, y, pb);
-			}
+	/* Each run but the last ends where another begins; skip the empty
+	 * white run of a row that starts black.
+	 */
+	for (k = runs[0] ? 0 : 1; k < n - 1; k++) {
+		int x = runs[k];
+
+		memmove(pb, pb + 1, sizeof(pb[0]) * 4);
+		pb[4] = x - (k ? runs[k - 1] : 0);
+		run_count++;
+
+		/* A black run ending completes a candidate */
+		if ((k & 1) && run_count >= 5) {
+			static int check[5] = {1, 1, 3, 1, 1};
+			int avg, err;
+			int i;
+			int ok = 1;
+
+			avg = (pb[0] + pb[1] + pb[3] + pb[4]) / 4;
+			err = avg * 3 / 4;
+
+			for (i = 0; i < 5; i++)
+				if (pb[i] < check[i] * avg - err ||
+				    pb[i] > check[i] * avg + err)
+					ok = 0;
+
+			if (ok)
+				test_capstone(q, x, y, pb);
 		}
-
-		run_length++;
-		last_color = color;
 	}
 }
 
@@ -1128,6 +1375,7 @@ static void test_grouping(struct quirc *q, int i)
 
 uint8_t *quirc_begin(struct quirc *q, int *w, int *h)
 {
+	q->binarized = 0;
 	q->num_regions = QUIRC_PIXEL_REGION;
 	q->num_capstones = 0;
 	q->num_grids = 0;
@@ -1140,11 +1388,111 @@ uint8_t *quirc_begin(struct quirc *q, int *w, int *h)
 	return q->image;
 }
 
+void quirc_set_roi(struct quirc *q, int x, int y, int w, int h)
+{
+	if (x < 0) {
+		w += x;
+		x = 0;
+	}
+
+	if (y < 0) {
+		h += y;
+		y = 0;
+	}
+
+	if (x + w > q->w)
+		w = q->w - x;
+
+	if (y + h > q->h)
+		h = q->h - y;
+
+	/* A hint entirely off the image leaves nothing to search; fall
+	 * back to the whole frame instead.
+	 */
+	if (w <= 0 || h <= 0) {
+		w = 0;
+		h = 0;
+	}
+
+	q->roi_x = x;
+	q->roi_y = y;
+	q->roi_w = w;
+	q->roi_h = h;
+}
+
+int quirc_find_bounds(const struct quirc *q,
+		      struct quirc_point *min, struct quirc_point *max)
+{
+	int found = 0;
+	int i, j;
+
+	min->x = q->w;
+	min->y = q->h;
+	max->x = -1;
+	max->y = -1;
+
+	/* Grids if any were formed, otherwise lone capstones */
+	for (i = 0; i < q->num_capstones; i++) {
+		const struct quirc_capstone *cap = &q->capstones[i];
+
+		if (q->num_grids > 0 && cap->qr_grid < 0)
+			continue;
+
+		for (j = 0; j < 4; j++) {
+			const struct quirc_point *p = &cap->corners[j];
+
+			if (p->x < min->x)
+				min->x = p->x;
+			if (p->y < min->y)
+				min->y = p->y;
+			if (p->x > max->x)
+				max->x = p->x;
+			if (p->y > max->y)
+				max->y = p->y;
+		}
+
+		found = 1;
+	}
+
+	for (i = 0; i < q->num_grids; i++) {
+		struct quirc_point corners[4];
+		const struct quirc_grid *qr = &q->grids[i];
+
+		perspective_map(qr->c, 0.0, 0.0, &corners[0]);
+		perspective_map(qr->c, qr->grid_size, 0.0, &corners[1]);
+		perspective_map(qr->c, qr->grid_size, qr->grid_size,
+				&corners[2]);
+		perspective_map(qr->c, 0.0, qr->grid_size, &corners[3]);
+
+		for (j = 0; j < 4; j++) {
+			if (corners[j].x < min->x)
+				min->x = corners[j].x;
+			if (corners[j].y < min->y)
+				min->y = corners[j].y;
+			if (corners[j].x > max->x)
+				max->x = corners[j].x;
+			if (corners[j].y > max->y)
+				max->y = corners[j].y;
+		}
+	}
+
+	return found;
+}
+
+void quirc_load_rgb565(struct quirc *q, const uint16_t *pixels, int stride)
+{
+	quirc_begin(q, NULL, NULL);
+
+	threshold_rgb565(q, pixels, stride);
+	q->binarized = 1;
+}
+
 void quirc_end(struct quirc *q)
 {
 	int i;
 
-	threshold(q);
+	if (!q->binarized)
+		threshold(q);
 
 	for (i = 0; i < q->h; i++)
 		finder_scan(q, i);
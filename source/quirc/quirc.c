@@ -38,6 +38,14 @@ void quirc_destroy(struct quirc *q)
 {
 	if (q->image)
 		free(q->image);
+	if (q->row_average)
+		free(q->row_average);
+	if (q->fill_stack)
+		free(q->fill_stack);
+	if (q->runs)
+		free(q->runs);
+	if (q->run_start)
+		free(q->run_start);
 
 	free(q);
 }
@@ -45,11 +53,43 @@ void quirc_destroy(struct quirc *q)
 int quirc_resize(struct quirc *q, int w, int h)
 {
 	uint8_t *new_image = realloc(q->image, w * h);
+	uint32_t *new_row_average;
+	uint16_t *new_runs;
+	uint16_t *new_run_start;
 
 	if (!new_image)
 		return -1;
 
 	q->image = new_image;
+
+	new_row_average = realloc(q->row_average, w * sizeof(*new_row_average));
+	if (!new_row_average)
+		return -1;
+
+	q->row_average = new_row_average;
+
+	new_runs = realloc(q->runs, (w + 1) * h * sizeof(*new_runs));
+	if (!new_runs)
+		return -1;
+
+	q->runs = new_runs;
+
+	new_run_start = realloc(q->run_start, h * sizeof(*new_run_start));
+	if (!new_run_start)
+		return -1;
+
+	q->run_start = new_run_start;
+
+	/* Grows during filling if needed */
+	if (!q->fill_stack) {
+		int size = w * 4 + 16;
+
+		q->fill_stack = malloc(size * sizeof(*q->fill_stack));
+		if (!q->fill_stack)
+			return -1;
+
+		q->fill_stack_size = size;
+	}
 	q->w = w;
 	q->h = h;
 
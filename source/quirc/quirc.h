@@ -52,12 +52,32 @@ int quirc_resize(struct quirc *q, int w, int h);
 uint8_t *quirc_begin(struct quirc *q, int *w, int *h);
 void quirc_end(struct quirc *q);
 
+/* Alternative to quirc_begin() for RGB565 input, with rows stride pixels
+ * apart. The image is converted to grayscale and thresholded in a single
+ * pass; call quirc_end() afterwards as usual.
+ */
+void quirc_load_rgb565(struct quirc *q, const uint16_t *pixels, int stride);
+
+/* Restricts thresholding, and so recognition, to a rectangle of the
+ * image; everything outside it is treated as white. The rectangle is
+ * clipped to the image and stays in effect until changed. A zero width
+ * or height searches the whole image again.
+ */
+void quirc_set_roi(struct quirc *q, int x, int y, int w, int h);
+
 /* This structure describes a location in the input image buffer. */
 struct quirc_point {
 	int	x;
 	int	y;
 };
 
+/* Obtain the bounding box of the codes located by the last quirc_end(),
+ * or of any capstones it found if no code could be formed. Returns 0 if
+ * nothing was found.
+ */
+int quirc_find_bounds(const struct quirc *q,
+		      struct quirc_point *min, struct quirc_point *max);
+
 /* This enum describes the various decoder errors which may occur. */
 typedef enum {
 	QUIRC_SUCCESS = 0,
@@ -69,6 +69,24 @@ struct quirc {
 	int			w;
 	int			h;
 
+	/* Thresholding scratch, one entry per column */
+	uint32_t		*row_average;
+	int			binarized;
+
+	/* Region of interest; searched alone when roi_w and roi_h are set */
+	int			roi_x;
+	int			roi_y;
+	int			roi_w;
+	int			roi_h;
+
+	/* Run-length encoded rows, w + 1 entries per row */
+	uint16_t		*runs;
+	uint16_t		*run_start;
+
+	/* Flood fill seeds */
+	struct quirc_point	*fill_stack;
+	int			fill_stack_size;
+
 	int			num_regions;
 	struct quirc_region	regions[QUIRC_MAX_REGIONS];
 
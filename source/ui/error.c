@@ -496,6 +496,14 @@ static const char* description_to_string(Result res) {
                     return "Invalid argument";
                 case R_FBI_THREAD_CREATE_FAILED:
                     return "Thread creation failed";
+                case R_FBI_HASH_MISMATCH:
+                    return "Hash mismatch";
+                case R_FBI_WRITE_STALLED:
+                    return "Write made no progress";
+                case R_FBI_BACKUP_MISMATCH:
+                    return "Existing backup cannot be continued";
+                case R_FBI_UNEXPECTED_EOF:
+                    return "Source ended early";
                 default:
                     break;
             }
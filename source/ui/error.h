@@ -6,6 +6,10 @@
 #define R_FBI_WRONG_SYSTEM MAKERESULT(RL_PERMANENT, RS_NOTSUPPORTED, RM_APPLICATION, 4)
 #define R_FBI_INVALID_ARGUMENT MAKERESULT(RL_PERMANENT, RS_INVALIDARG, RM_APPLICATION, 5)
 #define R_FBI_THREAD_CREATE_FAILED MAKERESULT(RL_PERMANENT, RS_INTERNAL, RM_APPLICATION, 6)
+#define R_FBI_HASH_MISMATCH MAKERESULT(RL_PERMANENT, RS_INVALIDSTATE, RM_APPLICATION, 7)
+#define R_FBI_WRITE_STALLED MAKERESULT(RL_PERMANENT, RS_INTERNAL, RM_APPLICATION, 8)
+#define R_FBI_BACKUP_MISMATCH MAKERESULT(RL_PERMANENT, RS_INVALIDSTATE, RM_APPLICATION, 9)
+#define R_FBI_UNEXPECTED_EOF MAKERESULT(RL_PERMANENT, RS_INVALIDSTATE, RM_APPLICATION, 10)
 
 #define R_FBI_OUT_OF_MEMORY MAKERESULT(RL_FATAL, RS_OUTOFRESOURCE, RM_APPLICATION, RD_OUT_OF_MEMORY)
 #define R_FBI_OUT_OF_RANGE MAKERESULT(RL_PERMANENT, RS_INVALIDARG, RM_APPLICATION, RD_OUT_OF_RANGE)
@@ -20,6 +20,7 @@ typedef struct {
     file_info* target;
 
     linked_list contents;
+    Handle contentsMutex;
 
     data_op_data deleteInfo;
 } delete_contents_data;
@@ -27,7 +28,7 @@ typedef struct {
 static void action_delete_contents_draw_top(ui_view* view, void* data, float x1, float y1, float x2, float y2) {
     delete_contents_data* deleteData = (delete_contents_data*) data;
 
-    u32 curr = deleteData->deleteInfo.processed;
+    u32 curr = deleteData->deleteInfo.current;
     if(curr < deleteData->deleteInfo.total) {
         ui_draw_file_info(view, ((list_item*) linked_list_get(&deleteData->contents, curr))->data, x1, y1, x2, y2);
     } else if(deleteData->target != NULL) {
@@ -35,6 +36,13 @@ static void action_delete_contents_draw_top(ui_view* view, void* data, float x1,
     }
 }
 
+static Result action_delete_contents_is_src_directory(void* data, u32 index, bool* isDirectory) {
+    delete_contents_data* deleteData = (delete_contents_data*) data;
+
+    *isDirectory = ((file_info*) ((list_item*) linked_list_get(&deleteData->contents, index))->data)->isDirectory;
+    return 0;
+}
+
 static Result action_delete_contents_delete(void* data, u32 index) {
     delete_contents_data* deleteData = (delete_contents_data*) data;
 
@@ -56,6 +64,8 @@ static Result action_delete_contents_delete(void* data, u32 index) {
     }
 
     if(R_SUCCEEDED(res)) {
+        svcWaitSynchronization(deleteData->contentsMutex, U64_MAX);
+
         deleteData->target->containsCias = false;
         deleteData->target->containsTickets = false;
 
@@ -75,6 +85,8 @@ static Result action_delete_contents_delete(void* data, u32 index) {
                 deleteData->target->containsTickets = true;
             }
         }
+
+        svcReleaseMutex(deleteData->contentsMutex);
     }
 
     return res;
@@ -99,6 +111,11 @@ static bool action_delete_contents_error(void* data, u32 index, Result res) {
 }
 
 static void action_delete_contents_free_data(delete_contents_data* data) {
+    if(data->contentsMutex != 0) {
+        svcCloseHandle(data->contentsMutex);
+        data->contentsMutex = 0;
+    }
+
     task_clear_files(&data->contents);
     linked_list_destroy(&data->contents);
     free(data);
@@ -162,6 +179,10 @@ static void action_delete_contents_internal(linked_list* items, list_item* selec
 
     data->deleteInfo.op = DATAOP_DELETE;
 
+    data->deleteInfo.concurrency = 4;
+
+    data->deleteInfo.isSrcDirectory = action_delete_contents_is_src_directory;
+
     data->deleteInfo.delete = action_delete_contents_delete;
 
     data->deleteInfo.error = action_delete_contents_error;
@@ -170,6 +191,14 @@ static void action_delete_contents_internal(linked_list* items, list_item* selec
 
     linked_list_init(&data->contents);
 
+    Result mutexRes = svcCreateMutex(&data->contentsMutex, false);
+    if(R_FAILED(mutexRes)) {
+        error_display_res(NULL, NULL, NULL, mutexRes, "Failed to create delete contents mutex.");
+
+        action_delete_contents_free_data(data);
+        return;
+    }
+
     populate_files_data popData;
     popData.items = &data->contents;
     popData.base = data->target;
@@ -209,6 +238,7 @@ static void action_delete_contents_internal(linked_list* items, list_item* selec
 
     data->deleteInfo.total = linked_list_size(&data->contents);
     data->deleteInfo.processed = data->deleteInfo.total;
+    data->deleteInfo.current = data->deleteInfo.total;
 
     prompt_display("Confirmation", message, COLOR_TEXT, true, data, NULL, action_delete_contents_draw_top, action_delete_contents_onresponse);
 }
@@ -1,5 +1,6 @@
 #include <malloc.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <3ds.h>
 
@@ -10,23 +11,130 @@
 #include "../../list.h"
 #include "../../prompt.h"
 #include "../../ui.h"
+#include "../../../core/config.h"
+#include "../../../core/http.h"
 #include "../../../core/linkedlist.h"
 #include "../../../core/screen.h"
 #include "../../../core/util.h"
 
 #define CONTENTS_MAX 256
 
+#define CDN_URL_DEFAULT "http://ccs.cdn.c.shop.nintendowifi.net/ccs/download/"
+
+// Contents downloaded at once, counting the one being installed.
+#define DOWNLOADS_MAX 8
+#define DOWNLOADS_DEFAULT 3
+#define DOWNLOAD_BUFFER_SIZE (128 * 1024)
+#define DOWNLOAD_DIR "/fbi/cdntmp/"
+
+#define CACHE_DIR "/fbi/cdncache/"
+#define CACHE_INDEX_PATH CACHE_DIR "index.dat"
+#define CACHE_INDEX_MAGIC 0x43494246
+#define CACHE_ENTRIES_MAX 1024
+#define CACHE_SIZE_DEFAULT_MIB 4096
+
+#define TMD_SIZE_MAX 0x8000
+#define BATCH_FAILURES_SHOWN 8
+
+typedef enum content_state_e {
+    CONTENT_PENDING,
+    CONTENT_STREAMING,
+    CONTENT_DOWNLOADING,
+    CONTENT_DOWNLOADED,
+    CONTENT_FAILED,
+    CONTENT_CACHED
+} content_state;
+
+typedef struct {
+    bool downloaded;
+    bool cached;
+    bool teed;
+    bool memory;
+    http_stream stream;
+    u32 fileHandle;
+} install_cdn_source;
+
+// The TMD hash covers the decrypted content, which only AM sees. An entry is
+// matched to its TMD by that hash and checked against the SHA-256 of the
+// stored bytes, which were only cached once AM accepted them.
+typedef struct {
+    u64 titleId;
+    u32 contentId;
+    u32 reserved;
+    u64 size;
+    u64 lastUsed;
+    u8 tmdHash[0x20];
+    u8 sha256[0x20];
+} cache_entry;
+
+typedef struct {
+    u32 magic;
+    u32 count;
+} cache_header;
+
+// Batch; every title's TMD is fetched first to size the whole job, then the
+// titles are installed one after another from those TMDs. A failed title is
+// recorded and skipped; cancelling one stops the rest.
+typedef struct {
+    ticket_info* tickets;
+    u32 count;
+
+    u8** tmds;
+    u32* tmdSizes;
+    u64* titleSizes;
+    Result* results;
+
+    volatile u32 fetched;
+    volatile u32 processed;
+    u64 totalSize;
+    volatile u64 processedSize;
+
+    volatile bool cancel;
+    volatile bool finished;
+
+    char summary[PROGRESS_TEXT_MAX];
+} install_cdns_data;
+
 typedef struct {
     ticket_info* ticket;
     volatile bool* done;
     bool finishedPrompt;
 
+    // Set when installing as part of a batch, which handles all reporting.
+    install_cdns_data* batch;
+    u32 batchIndex;
+    u64 installedSize;
+
     u32 contentCount;
     u16 contentIndices[CONTENTS_MAX];
     u32 contentIds[CONTENTS_MAX];
+    u64 contentSizes[CONTENTS_MAX];
+    u8 contentHashes[CONTENTS_MAX][0x20];
 
     u32 responseCode;
 
+    // Prefetching; the contents after the one being installed are downloaded
+    // to the SD card alongside it and installed from there, in index order.
+    u32 downloads;
+    Handle downloadMutex;
+    Thread downloadThreads[DOWNLOADS_MAX - 1];
+    volatile bool downloadStop;
+    volatile u32 currIndex;
+    volatile content_state contentStates[CONTENTS_MAX];
+    FS_Archive sdmcArchive;
+
+    // Cache; on when /fbi/cdncache/ exists. Contents installed from the CDN
+    // are kept under their title and content IDs and reused by later
+    // installs, least recently used first out past the size cap.
+    bool cache;
+    u64 cacheSizeMax;
+    cache_entry* cacheEntries;
+    u32 cacheCount;
+    u32 cacheFileHandle;
+    bool cacheReading;
+    bool cacheHashed;
+    u8 cacheSha256[0x20];
+
     data_op_data installInfo;
 } install_cdn_data;
 
@@ -39,37 +147,458 @@ static Result action_install_cdn_make_dst_directory(void* data, u32 index) {
     return 0;
 }
 
-static Result action_install_cdn_open_src(void* data, u32 index, u32* handle) {
-    install_cdn_data* installData = (install_cdn_data*) data;
+static Result action_install_cdn_open_url(const char* base, u64 titleId, const char* name, http_stream* stream) {
+    const char* separator = base[0] != '\0' && base[strlen(base) - 1] == '/' ? "" : "/";
+
+    char url[HTTP_URL_MAX];
+    snprintf(url, sizeof(url), "%s%s%016llX/%s", base, separator, titleId, name);
+
+    return http_stream_open(stream, url);
+}
+
+// A mirror that is down or lacks the content falls back to the CDN itself.
+static Result action_install_cdn_open_title_stream(u64 titleId, const char* name, http_stream* stream) {
+    const char* base = config_get_string("cdn_url", CDN_URL_DEFAULT);
+
+    Result res = action_install_cdn_open_url(base, titleId, name, stream);
+    if(R_FAILED(res) && strcmp(base, CDN_URL_DEFAULT) != 0 && config_get_bool("cdn_fallback", true)) {
+        res = action_install_cdn_open_url(CDN_URL_DEFAULT, titleId, name, stream);
+    }
+
+    return res;
+}
+
+static Result action_install_cdn_open_stream(install_cdn_data* installData, u32 index, http_stream* stream, u32* responseCode) {
+    char name[16] = "tmd";
+    if(index > 0) {
+        snprintf(name, sizeof(name), "%08lX", installData->contentIds[index - 1]);
+    }
+
+    Result res = action_install_cdn_open_title_stream(installData->ticket->titleId, name, stream);
 
+    *responseCode = stream->responseCode;
+    return res;
+}
+
+static Result action_install_cdn_open_file(install_cdn_data* installData, const char* path, u32* handle, u32 flags) {
     Result res = 0;
 
-    httpcContext* context = (httpcContext*) calloc(1, sizeof(httpcContext));
-    if(context != NULL) {
-        char url[256];
-        if(index == 0) {
-            snprintf(url, 256, "http://ccs.cdn.c.shop.nintendowifi.net/ccs/download/%016llX/tmd", installData->ticket->titleId);
+    FS_Path* fsPath = util_make_path_utf8(path);
+    if(fsPath != NULL) {
+        res = FSUSER_OpenFile(handle, installData->sdmcArchive, *fsPath, flags, 0);
+
+        util_free_path_utf8(fsPath);
+    } else {
+        res = R_FBI_OUT_OF_MEMORY;
+    }
+
+    return res;
+}
+
+static void action_install_cdn_make_content_path(char* path, u32 size, const char* dir, u64 titleId, u32 contentId, const char* suffix) {
+    snprintf(path, size, "%s%016llX_%08lX%s", dir, titleId, contentId, suffix);
+}
+
+static Result action_install_cdn_open_content(install_cdn_data* installData, const char* dir, u32 index, const char* suffix, u32* handle, u32 flags) {
+    char path[FILE_PATH_MAX];
+    action_install_cdn_make_content_path(path, sizeof(path), dir, installData->ticket->titleId, installData->contentIds[index - 1], suffix);
+
+    return action_install_cdn_open_file(installData, path, handle, flags);
+}
+
+static void action_install_cdn_delete_content(install_cdn_data* installData, const char* dir, u64 titleId, u32 contentId, const char* suffix) {
+    char path[FILE_PATH_MAX];
+    action_install_cdn_make_content_path(path, sizeof(path), dir, titleId, contentId, suffix);
+
+    FS_Path* fsPath = util_make_path_utf8(path);
+    if(fsPath != NULL) {
+        FSUSER_DeleteFile(installData->sdmcArchive, *fsPath);
+
+        util_free_path_utf8(fsPath);
+    }
+}
+
+static Result action_install_cdn_open_download(install_cdn_data* installData, u32 index, u32* handle, u32 flags) {
+    return action_install_cdn_open_content(installData, DOWNLOAD_DIR, index, "", handle, flags);
+}
+
+static void action_install_cdn_delete_download(install_cdn_data* installData, u32 index) {
+    action_install_cdn_delete_content(installData, DOWNLOAD_DIR, installData->ticket->titleId, installData->contentIds[index - 1], "");
+}
+
+static cache_entry* action_install_cdn_cache_find(install_cdn_data* installData, u32 index) {
+    for(u32 i = 0; i < installData->cacheCount; i++) {
+        cache_entry* entry = &installData->cacheEntries[i];
+        if(entry->titleId == installData->ticket->titleId && entry->contentId == installData->contentIds[index - 1]) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static void action_install_cdn_cache_remove(install_cdn_data* installData, cache_entry* entry) {
+    action_install_cdn_delete_content(installData, CACHE_DIR, entry->titleId, entry->contentId, "");
+
+    *entry = installData->cacheEntries[--installData->cacheCount];
+}
+
+static void action_install_cdn_cache_save(install_cdn_data* installData) {
+    u32 handle = 0;
+    if(R_SUCCEEDED(action_install_cdn_open_file(installData, CACHE_INDEX_PATH, &handle, FS_OPEN_WRITE | FS_OPEN_CREATE))) {
+        cache_header header = {CACHE_INDEX_MAGIC, installData->cacheCount};
+
+        u32 bytesWritten = 0;
+        if(R_SUCCEEDED(FSFILE_SetSize(handle, 0)) && R_SUCCEEDED(FSFILE_Write(handle, &bytesWritten, 0, &header, sizeof(header), 0))) {
+            FSFILE_Write(handle, &bytesWritten, sizeof(header), installData->cacheEntries, installData->cacheCount * sizeof(cache_entry), FS_WRITE_FLUSH);
+        }
+
+        FSFILE_Close(handle);
+    }
+}
+
+// Loads the index and marks the contents it can supply, so they are not prefetched.
+static void action_install_cdn_cache_load(install_cdn_data* installData) {
+    if(!installData->cache) {
+        return;
+    }
+
+    if((installData->cacheEntries = (cache_entry*) calloc(CACHE_ENTRIES_MAX, sizeof(cache_entry))) == NULL) {
+        installData->cache = false;
+        return;
+    }
+
+    u32 handle = 0;
+    if(R_SUCCEEDED(action_install_cdn_open_file(installData, CACHE_INDEX_PATH, &handle, FS_OPEN_READ))) {
+        cache_header header;
+
+        u32 bytesRead = 0;
+        if(R_SUCCEEDED(FSFILE_Read(handle, &bytesRead, 0, &header, sizeof(header))) && bytesRead == sizeof(header)
+           && header.magic == CACHE_INDEX_MAGIC && header.count <= CACHE_ENTRIES_MAX
+           && R_SUCCEEDED(FSFILE_Read(handle, &bytesRead, sizeof(header), installData->cacheEntries, header.count * sizeof(cache_entry)))
+           && bytesRead == header.count * sizeof(cache_entry)) {
+            installData->cacheCount = header.count;
+        }
+
+        FSFILE_Close(handle);
+    }
+
+    for(u32 i = 0; i < installData->contentCount; i++) {
+        cache_entry* entry = action_install_cdn_cache_find(installData, i + 1);
+        if(entry != NULL && entry->size == installData->contentSizes[i] && memcmp(entry->tmdHash, installData->contentHashes[i], sizeof(entry->tmdHash)) == 0) {
+            installData->contentStates[i] = CONTENT_CACHED;
+        }
+    }
+}
+
+static void action_install_cdn_cache_evict(install_cdn_data* installData, u64 total, u32 count) {
+    while(installData->cacheCount > 0 && (total > installData->cacheSizeMax || installData->cacheCount > count)) {
+        cache_entry* oldest = &installData->cacheEntries[0];
+        for(u32 i = 1; i < installData->cacheCount; i++) {
+            if(installData->cacheEntries[i].lastUsed < oldest->lastUsed) {
+                oldest = &installData->cacheEntries[i];
+            }
+        }
+
+        total -= oldest->size;
+        action_install_cdn_cache_remove(installData, oldest);
+    }
+}
+
+// Moves a content AM has just accepted into the cache.
+static void action_install_cdn_cache_add(install_cdn_data* installData, u32 index, const char* dir, const char* suffix) {
+    cache_entry* entry = action_install_cdn_cache_find(installData, index);
+    if(entry != NULL) {
+        action_install_cdn_cache_remove(installData, entry);
+    }
+
+    u64 total = installData->contentSizes[index - 1];
+    for(u32 i = 0; i < installData->cacheCount; i++) {
+        total += installData->cacheEntries[i].size;
+    }
+
+    action_install_cdn_cache_evict(installData, total, CACHE_ENTRIES_MAX - 1);
+
+    char srcPath[FILE_PATH_MAX];
+    char dstPath[FILE_PATH_MAX];
+    action_install_cdn_make_content_path(srcPath, sizeof(srcPath), dir, installData->ticket->titleId, installData->contentIds[index - 1], suffix);
+    action_install_cdn_make_content_path(dstPath, sizeof(dstPath), CACHE_DIR, installData->ticket->titleId, installData->contentIds[index - 1], "");
+
+    Result res = R_FBI_OUT_OF_MEMORY;
+
+    FS_Path* srcFsPath = util_make_path_utf8(srcPath);
+    if(srcFsPath != NULL) {
+        FS_Path* dstFsPath = util_make_path_utf8(dstPath);
+        if(dstFsPath != NULL) {
+            FSUSER_DeleteFile(installData->sdmcArchive, *dstFsPath);
+            res = FSUSER_RenameFile(installData->sdmcArchive, *srcFsPath, installData->sdmcArchive, *dstFsPath);
+
+            util_free_path_utf8(dstFsPath);
+        }
+
+        if(R_FAILED(res)) {
+            FSUSER_DeleteFile(installData->sdmcArchive, *srcFsPath);
+        }
+
+        util_free_path_utf8(srcFsPath);
+    }
+
+    if(R_SUCCEEDED(res) && total <= installData->cacheSizeMax) {
+        entry = &installData->cacheEntries[installData->cacheCount++];
+        memset(entry, 0, sizeof(cache_entry));
+
+        entry->titleId = installData->ticket->titleId;
+        entry->contentId = installData->contentIds[index - 1];
+        entry->size = installData->contentSizes[index - 1];
+        entry->lastUsed = osGetTime();
+        memcpy(entry->tmdHash, installData->contentHashes[index - 1], sizeof(entry->tmdHash));
+        memcpy(entry->sha256, installData->cacheSha256, sizeof(entry->sha256));
+    } else if(R_SUCCEEDED(res)) {
+        action_install_cdn_delete_content(installData, CACHE_DIR, installData->ticket->titleId, installData->contentIds[index - 1], "");
+    }
+
+    action_install_cdn_cache_save(installData);
+}
+
+// Settles the cache once a content's install has finished or failed.
+static void action_install_cdn_cache_close(install_cdn_data* installData, u32 index, install_cdn_source* source, bool succeeded) {
+    if(installData->cacheFileHandle != 0) {
+        FSFILE_Close(installData->cacheFileHandle);
+        installData->cacheFileHandle = 0;
+    }
+
+    bool accepted = succeeded && installData->cacheHashed;
+
+    if(source->cached) {
+        cache_entry* entry = action_install_cdn_cache_find(installData, index);
+        if(entry != NULL) {
+            if(accepted) {
+                entry->lastUsed = osGetTime();
+            } else if(installData->cacheHashed) {
+                action_install_cdn_cache_remove(installData, entry);
+            }
+
+            action_install_cdn_cache_save(installData);
+        }
+    } else if(source->downloaded) {
+        if(accepted) {
+            action_install_cdn_cache_add(installData, index, DOWNLOAD_DIR, "");
+        }
+    } else if(source->teed) {
+        if(accepted) {
+            action_install_cdn_cache_add(installData, index, CACHE_DIR, ".tmp");
         } else {
-            snprintf(url, 256, "http://ccs.cdn.c.shop.nintendowifi.net/ccs/download/%016llX/%08lX", installData->ticket->titleId, installData->contentIds[index - 1]);
+            action_install_cdn_delete_content(installData, CACHE_DIR, installData->ticket->titleId, installData->contentIds[index - 1], ".tmp");
         }
+    }
+}
 
-        if(R_SUCCEEDED(res = httpcOpenContext(context, HTTPC_METHOD_GET, url, 1))) {
-            httpcSetSSLOpt(context, SSLCOPT_DisableVerify);
-            if(R_SUCCEEDED(res = httpcBeginRequest(context)) && R_SUCCEEDED(res = httpcGetResponseStatusCode(context, &installData->responseCode, 0))) {
-                if(installData->responseCode == 200) {
-                    *handle = (u32) context;
-                } else {
-                    res = R_FBI_HTTP_RESPONSE_CODE;
+static Result action_install_cdn_download(install_cdn_data* installData, u32 index, u8* buffer) {
+    Result res = 0;
+
+    u32 responseCode = 0;
+    http_stream stream;
+    if(R_SUCCEEDED(res = action_install_cdn_open_stream(installData, index, &stream, &responseCode))) {
+        u32 fileHandle = 0;
+        if(R_SUCCEEDED(res = action_install_cdn_open_download(installData, index, &fileHandle, FS_OPEN_WRITE | FS_OPEN_CREATE))
+           && R_SUCCEEDED(res = FSFILE_SetSize(fileHandle, 0))) {
+            u64 offset = 0;
+            while(offset < stream.size) {
+                // The data op thread raises downloadStop on cancel; cancelEvent
+                // itself may already be closed by the time this runs.
+                if(installData->downloadStop) {
+                    res = R_FBI_CANCELLED;
+                    break;
                 }
-            }
 
-            if(R_FAILED(res)) {
-                httpcCloseContext(context);
+                u32 bytesRead = 0;
+                if(R_FAILED(res = http_stream_read(&stream, &bytesRead, buffer, DOWNLOAD_BUFFER_SIZE))) {
+                    break;
+                }
+
+                u32 bytesWritten = 0;
+                if(bytesRead > 0 && R_FAILED(res = FSFILE_Write(fileHandle, &bytesWritten, offset, buffer, bytesRead, 0))) {
+                    break;
+                }
+
+                offset += bytesRead;
             }
         }
 
+        if(fileHandle != 0) {
+            FSFILE_Close(fileHandle);
+        }
+
         if(R_FAILED(res)) {
-            free(context);
+            action_install_cdn_delete_download(installData, index);
+        }
+
+        http_stream_close(&stream);
+    }
+
+    return res;
+}
+
+// Claims the next pending content within the window ahead of the install.
+static void action_install_cdn_download_thread(void* arg) {
+    install_cdn_data* installData = (install_cdn_data*) arg;
+
+    u8* buffer = (u8*) calloc(1, DOWNLOAD_BUFFER_SIZE);
+    if(buffer == NULL) {
+        return;
+    }
+
+    while(!installData->downloadStop) {
+        u32 index = 0;
+
+        svcWaitSynchronization(installData->downloadMutex, U64_MAX);
+
+        u32 last = installData->currIndex + installData->downloads - 1;
+        if(last > installData->contentCount) {
+            last = installData->contentCount;
+        }
+
+        bool finished = installData->currIndex >= installData->contentCount;
+        for(u32 i = installData->currIndex + 1; i <= last; i++) {
+            if(installData->contentStates[i - 1] == CONTENT_PENDING) {
+                installData->contentStates[i - 1] = CONTENT_DOWNLOADING;
+                index = i;
+                break;
+            }
+        }
+
+        svcReleaseMutex(installData->downloadMutex);
+
+        if(index == 0) {
+            if(finished) {
+                break;
+            }
+
+            svcSleepThread(10000000);
+            continue;
+        }
+
+        Result res = action_install_cdn_download(installData, index, buffer);
+
+        svcWaitSynchronization(installData->downloadMutex, U64_MAX);
+        installData->contentStates[index - 1] = R_SUCCEEDED(res) ? CONTENT_DOWNLOADED : CONTENT_FAILED;
+        svcReleaseMutex(installData->downloadMutex);
+    }
+
+    free(buffer);
+}
+
+// Best effort; without the SD card or threads, contents are streamed one at a time.
+// Downloads are stopped from the data op thread, by the last content's closeSrc
+// or by the error callback, before the data op closes cancelEvent.
+static void action_install_cdn_start_downloads(install_cdn_data* installData) {
+    if(installData->downloads <= 1 || installData->contentCount <= 1 || installData->sdmcArchive == 0) {
+        return;
+    }
+
+    if(R_FAILED(util_ensure_dir(installData->sdmcArchive, "/fbi/")) || R_FAILED(util_ensure_dir(installData->sdmcArchive, DOWNLOAD_DIR))
+       || R_FAILED(svcCreateMutex(&installData->downloadMutex, false))) {
+        return;
+    }
+
+    installData->downloadStop = false;
+
+    for(u32 i = 0; i < installData->downloads - 1 && i < DOWNLOADS_MAX - 1; i++) {
+        installData->downloadThreads[i] = threadCreate(action_install_cdn_download_thread, installData, 0x10000, 0x18, 1, false);
+    }
+}
+
+static void action_install_cdn_stop_downloads(install_cdn_data* installData) {
+    installData->downloadStop = true;
+
+    for(u32 i = 0; i < DOWNLOADS_MAX - 1; i++) {
+        if(installData->downloadThreads[i] != NULL) {
+            threadJoin(installData->downloadThreads[i], U64_MAX);
+            threadFree(installData->downloadThreads[i]);
+            installData->downloadThreads[i] = NULL;
+        }
+    }
+
+    for(u32 i = 0; i < installData->contentCount; i++) {
+        if(installData->contentStates[i] == CONTENT_DOWNLOADED) {
+            action_install_cdn_delete_download(installData, i + 1);
+            installData->contentStates[i] = CONTENT_STREAMING;
+        }
+    }
+
+    if(installData->downloadMutex != 0) {
+        svcCloseHandle(installData->downloadMutex);
+        installData->downloadMutex = 0;
+    }
+}
+
+// Marks the content as being installed, waiting out a download already under way.
+static Result action_install_cdn_claim_content(install_cdn_data* installData, u32 index, content_state* state) {
+    installData->currIndex = index;
+
+    if(installData->downloadMutex == 0) {
+        *state = installData->contentStates[index - 1] == CONTENT_CACHED ? CONTENT_CACHED : CONTENT_STREAMING;
+        return 0;
+    }
+
+    while(true) {
+        svcWaitSynchronization(installData->downloadMutex, U64_MAX);
+
+        if(installData->contentStates[index - 1] == CONTENT_PENDING) {
+            installData->contentStates[index - 1] = CONTENT_STREAMING;
+        }
+
+        *state = installData->contentStates[index - 1];
+
+        svcReleaseMutex(installData->downloadMutex);
+
+        if(*state != CONTENT_DOWNLOADING) {
+            return 0;
+        }
+
+        if(task_is_quit_all() || svcWaitSynchronization(installData->installInfo.cancelEvent, 0) == 0) {
+            return R_FBI_CANCELLED;
+        }
+
+        svcSleepThread(10000000);
+    }
+}
+
+static Result action_install_cdn_open_src(void* data, u32 index, u32* handle) {
+    install_cdn_data* installData = (install_cdn_data*) data;
+
+    Result res = 0;
+
+    install_cdn_source* source = (install_cdn_source*) calloc(1, sizeof(install_cdn_source));
+    if(source != NULL) {
+        content_state state = CONTENT_STREAMING;
+        if(index == 0 || R_SUCCEEDED(res = action_install_cdn_claim_content(installData, index, &state))) {
+            // Contents missing from the cache or downloads are fetched straight from the CDN.
+            // Batches have already fetched the TMD.
+            source->memory = index == 0 && installData->batch != NULL;
+            source->cached = state == CONTENT_CACHED && R_SUCCEEDED(action_install_cdn_open_content(installData, CACHE_DIR, index, "", &source->fileHandle, FS_OPEN_READ));
+            source->downloaded = state == CONTENT_DOWNLOADED && R_SUCCEEDED(action_install_cdn_open_download(installData, index, &source->fileHandle, FS_OPEN_READ));
+
+            if(!source->memory && !source->cached && !source->downloaded) {
+                res = action_install_cdn_open_stream(installData, index, &source->stream, &installData->responseCode);
+            }
+
+            // Streamed contents are also written to the cache as they install.
+            if(R_SUCCEEDED(res) && index > 0 && installData->cache && !source->cached && !source->downloaded
+               && installData->contentSizes[index - 1] <= installData->cacheSizeMax
+               && R_SUCCEEDED(action_install_cdn_open_content(installData, CACHE_DIR, index, ".tmp", &installData->cacheFileHandle, FS_OPEN_WRITE | FS_OPEN_CREATE))) {
+                FSFILE_SetSize(installData->cacheFileHandle, 0);
+                source->teed = true;
+            }
+
+            installData->cacheReading = source->cached;
+            installData->cacheHashed = false;
+        }
+
+        if(R_SUCCEEDED(res)) {
+            *handle = (u32) source;
+        } else {
+            free(source);
         }
     } else {
         res = R_FBI_OUT_OF_MEMORY;
@@ -79,20 +608,75 @@ static Result action_install_cdn_open_src(void* data, u32 index, u32* handle) {
 }
 
 static Result action_install_cdn_close_src(void* data, u32 index, bool succeeded, u32 handle) {
-    return httpcCloseContext((httpcContext*) handle);
+    install_cdn_data* installData = (install_cdn_data*) data;
+    install_cdn_source* source = (install_cdn_source*) handle;
+
+    Result res = 0;
+
+    if(source->cached || source->downloaded) {
+        res = FSFILE_Close(source->fileHandle);
+    } else if(!source->memory) {
+        res = http_stream_close(&source->stream);
+    }
+
+    if(succeeded && index > 0) {
+        installData->installedSize += installData->contentSizes[index - 1];
+    }
+
+    if(index > 0 && installData->cache) {
+        action_install_cdn_cache_close(installData, index, source, succeeded);
+    }
+
+    if(source->downloaded) {
+        action_install_cdn_delete_download(installData, index);
+        installData->contentStates[index - 1] = CONTENT_STREAMING;
+    }
+
+    if(index > 0 && index >= installData->contentCount) {
+        action_install_cdn_stop_downloads(installData);
+    }
+
+    free(source);
+    return res;
 }
 
 static Result action_install_cdn_get_src_size(void* data, u32 handle, u64* size) {
-    u32 downloadSize = 0;
-    Result res = httpcGetDownloadSizeState((httpcContext*) handle, NULL, &downloadSize);
+    install_cdn_data* installData = (install_cdn_data*) data;
+    install_cdn_source* source = (install_cdn_source*) handle;
 
-    *size = downloadSize;
-    return res;
+    if(source->memory) {
+        *size = installData->batch->tmdSizes[installData->batchIndex];
+        return 0;
+    }
+
+    if(source->cached || source->downloaded) {
+        return FSFILE_GetSize(source->fileHandle, size);
+    }
+
+    return http_stream_get_size(&source->stream, size);
 }
 
 static Result action_install_cdn_read_src(void* data, u32 handle, u32* bytesRead, void* buffer, u64 offset, u32 size) {
-    Result res = httpcDownloadData((httpcContext*) handle, buffer, size, bytesRead);
-    return res != HTTPC_RESULTCODE_DOWNLOADPENDING ? res : 0;
+    install_cdn_data* installData = (install_cdn_data*) data;
+    install_cdn_source* source = (install_cdn_source*) handle;
+
+    if(source->memory) {
+        u32 tmdSize = installData->batch->tmdSizes[installData->batchIndex];
+
+        *bytesRead = offset < tmdSize ? tmdSize - (u32) offset : 0;
+        if(*bytesRead > size) {
+            *bytesRead = size;
+        }
+
+        memcpy(buffer, installData->batch->tmds[installData->batchIndex] + offset, *bytesRead);
+        return 0;
+    }
+
+    if(source->cached || source->downloaded) {
+        return FSFILE_Read(source->fileHandle, bytesRead, offset, buffer, size);
+    }
+
+    return http_stream_read(&source->stream, bytesRead, buffer, size);
 }
 
 static Result action_install_cdn_open_dst(void* data, u32 index, void* initialReadBlock, u32* handle) {
@@ -109,11 +693,23 @@ static Result action_install_cdn_open_dst(void* data, u32 index, void* initialRe
 
             installData->contentIds[i] = __builtin_bswap32(*(u32*) &contentChunk[0x00]);
             installData->contentIndices[i] = __builtin_bswap16(*(u16*) &contentChunk[0x04]);
+
+            u64 contentSize = 0;
+            memcpy(&contentSize, &contentChunk[0x08], sizeof(contentSize));
+            installData->contentSizes[i] = __builtin_bswap64(contentSize);
+
+            memcpy(installData->contentHashes[i], &contentChunk[0x10], sizeof(installData->contentHashes[i]));
         }
 
         installData->installInfo.total += installData->contentCount;
 
-        return AM_InstallTmdBegin(handle);
+        Result res = AM_InstallTmdBegin(handle);
+        if(R_SUCCEEDED(res)) {
+            action_install_cdn_cache_load(installData);
+            action_install_cdn_start_downloads(installData);
+        }
+
+        return res;
     } else {
         return AM_InstallContentBegin(handle, installData->contentIndices[index - 1]);
     }
@@ -136,13 +732,50 @@ static Result action_install_cdn_close_dst(void* data, u32 index, bool succeeded
 }
 
 static Result action_install_cdn_write_dst(void* data, u32 handle, u32* bytesWritten, void* buffer, u64 offset, u32 size) {
-    return FSFILE_Write(handle, bytesWritten, offset, buffer, size, 0);
+    install_cdn_data* installData = (install_cdn_data*) data;
+
+    Result res = FSFILE_Write(handle, bytesWritten, offset, buffer, size, 0);
+
+    // Caching is best effort; a failed write just drops the copy.
+    u32 cacheBytesWritten = 0;
+    if(R_SUCCEEDED(res) && installData->cacheFileHandle != 0
+       && R_FAILED(FSFILE_Write(installData->cacheFileHandle, &cacheBytesWritten, offset, buffer, *bytesWritten, 0))) {
+        FSFILE_Close(installData->cacheFileHandle);
+        installData->cacheFileHandle = 0;
+    }
+
+    return res;
+}
+
+static Result action_install_cdn_hash_dst(void* data, u32 index, u8* sha256, u32 crc32) {
+    install_cdn_data* installData = (install_cdn_data*) data;
+
+    if(index == 0) {
+        return 0;
+    }
+
+    if(installData->cacheReading) {
+        cache_entry* entry = action_install_cdn_cache_find(installData, index);
+        if(entry != NULL && memcmp(entry->sha256, sha256, sizeof(entry->sha256)) != 0) {
+            installData->cacheHashed = true;
+            return R_FBI_HASH_MISMATCH;
+        }
+    }
+
+    memcpy(installData->cacheSha256, sha256, sizeof(installData->cacheSha256));
+    installData->cacheHashed = true;
+
+    return 0;
 }
 
 bool action_install_cdn_error(void* data, u32 index, Result res) {
     install_cdn_data* installData = (install_cdn_data*) data;
 
-    if(res == R_FBI_CANCELLED) {
+    action_install_cdn_stop_downloads(installData);
+
+    if(installData->batch != NULL) {
+        installData->batch->results[installData->batchIndex] = res;
+    } else if(res == R_FBI_CANCELLED) {
         prompt_display("Failure", "Install cancelled.", COLOR_TEXT, false, installData->ticket, NULL, ui_draw_ticket_info, NULL);
     } else if(res == R_FBI_HTTP_RESPONSE_CODE) {
         error_display(NULL, installData->ticket, ui_draw_ticket_info, "Failed to install CDN title.\nHTTP server returned response code %d", installData->responseCode);
@@ -158,6 +791,18 @@ static void action_install_cdn_draw_top(ui_view* view, void* data, float x1, flo
 }
 
 static void action_install_cdn_free_data(install_cdn_data* data) {
+    action_install_cdn_stop_downloads(data);
+
+    if(data->cacheEntries != NULL) {
+        free(data->cacheEntries);
+        data->cacheEntries = NULL;
+    }
+
+    if(data->sdmcArchive != 0) {
+        FSUSER_CloseArchive(data->sdmcArchive);
+        data->sdmcArchive = 0;
+    }
+
     if(data->done != NULL) {
         *data->done = true;
     }
@@ -192,11 +837,15 @@ static void action_install_cdn_update(ui_view* view, void* data, float* progress
         } else {
             AM_InstallTitleAbort();
 
-            if(R_FAILED(res)) {
+            if(R_FAILED(res) && installData->batch == NULL) {
                 error_display_res(NULL, installData->ticket, ui_draw_ticket_info, res, "Failed to install CDN title.");
             }
         }
 
+        if(installData->batch != NULL) {
+            installData->batch->results[installData->batchIndex] = R_FAILED(installData->installInfo.result) ? installData->installInfo.result : res;
+        }
+
         action_install_cdn_free_data(installData);
 
         return;
@@ -208,12 +857,28 @@ static void action_install_cdn_update(ui_view* view, void* data, float* progress
 
     *progress = installData->installInfo.currTotal != 0 ? (float) ((double) installData->installInfo.currProcessed / (double) installData->installInfo.currTotal) : 0;
     snprintf(text, PROGRESS_TEXT_MAX, "%lu / %lu\n%.2f MiB / %.2f MiB", installData->installInfo.processed, installData->installInfo.total, installData->installInfo.currProcessed / 1024.0 / 1024.0, installData->installInfo.currTotal / 1024.0 / 1024.0);
+
+    install_cdns_data* batch = installData->batch;
+    if(batch != NULL) {
+        u64 batchProcessed = batch->processedSize + installData->installedSize + installData->installInfo.currProcessed;
+
+        size_t len = strlen(text);
+        snprintf(text + len, PROGRESS_TEXT_MAX - len, "\nTitle %lu / %lu, %.2f MiB / %.2f MiB total", installData->batchIndex + 1, batch->count, batchProcessed / 1024.0 / 1024.0, batch->totalSize / 1024.0 / 1024.0);
+    }
 }
 
-void action_install_cdn_noprompt(volatile bool* done, ticket_info* info, bool finishedPrompt) {
+static void action_install_cdn_start(volatile bool* done, ticket_info* info, bool finishedPrompt, install_cdns_data* batch, u32 batchIndex) {
     install_cdn_data* data = (install_cdn_data*) calloc(1, sizeof(install_cdn_data));
     if(data == NULL) {
-        error_display(NULL, NULL, NULL, "Failed to allocate install CDN data.");
+        if(batch != NULL) {
+            batch->results[batchIndex] = R_FBI_OUT_OF_MEMORY;
+        } else {
+            error_display(NULL, NULL, NULL, "Failed to allocate install CDN data.");
+        }
+
+        if(done != NULL) {
+            *done = true;
+        }
 
         return;
     }
@@ -222,8 +887,19 @@ void action_install_cdn_noprompt(volatile bool* done, ticket_info* info, bool fi
     data->done = done;
     data->finishedPrompt = finishedPrompt;
 
+    data->batch = batch;
+    data->batchIndex = batchIndex;
+
     data->responseCode = 0;
 
+    data->downloads = config_get_u32("cdn_downloads", DOWNLOADS_DEFAULT);
+    if(data->downloads < 1) {
+        data->downloads = 1;
+    } else if(data->downloads > DOWNLOADS_MAX) {
+        data->downloads = DOWNLOADS_MAX;
+    }
+    data->cacheSizeMax = (u64) config_get_u32("cdn_cache_mib", CACHE_SIZE_DEFAULT_MIB) * 1024 * 1024;
+
     data->installInfo.data = data;
 
     data->installInfo.op = DATAOP_COPY;
@@ -248,6 +924,17 @@ void action_install_cdn_noprompt(volatile bool* done, ticket_info* info, bool fi
 
     data->installInfo.finished = true;
 
+    // Without the SD card, contents are streamed one at a time and not cached.
+    if(R_SUCCEEDED(FSUSER_OpenArchive(&data->sdmcArchive, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, "")))) {
+        data->cache = util_is_dir(data->sdmcArchive, CACHE_DIR);
+    } else {
+        data->sdmcArchive = 0;
+    }
+
+    if(data->cache) {
+        data->installInfo.hashDst = action_install_cdn_hash_dst;
+    }
+
     Result res = 0;
 
     u8 n3ds = false;
@@ -271,12 +958,20 @@ void action_install_cdn_noprompt(volatile bool* done, ticket_info* info, bool fi
     }
 
     if(R_FAILED(res)) {
-        error_display_res(NULL, data->ticket, ui_draw_ticket_info, res, "Failed to initiate CDN title installation.");
+        if(batch != NULL) {
+            batch->results[batchIndex] = res;
+        } else {
+            error_display_res(NULL, data->ticket, ui_draw_ticket_info, res, "Failed to initiate CDN title installation.");
+        }
 
         action_install_cdn_free_data(data);
     }
 }
 
+void action_install_cdn_noprompt(volatile bool* done, ticket_info* info, bool finishedPrompt) {
+    action_install_cdn_start(done, info, finishedPrompt, NULL, 0);
+}
+
 static void action_install_cdn_onresponse(ui_view* view, void* data, bool response) {
     ticket_info* info = (ticket_info*) data;
 
@@ -287,4 +982,234 @@ static void action_install_cdn_onresponse(ui_view* view, void* data, bool respon
 
 void action_install_cdn(linked_list* items, list_item* selected) {
     prompt_display("Confirmation", "Install the selected title from the CDN?", COLOR_TEXT, true, selected->data, NULL, ui_draw_ticket_info, action_install_cdn_onresponse);
-}
\ No newline at end of file
+}
+
+static void action_install_cdns_free_data(install_cdns_data* data) {
+    if(data->tmds != NULL) {
+        for(u32 i = 0; i < data->count; i++) {
+            if(data->tmds[i] != NULL) {
+                free(data->tmds[i]);
+            }
+        }
+
+        free(data->tmds);
+    }
+
+    if(data->tmdSizes != NULL) {
+        free(data->tmdSizes);
+    }
+
+    if(data->titleSizes != NULL) {
+        free(data->titleSizes);
+    }
+
+    if(data->results != NULL) {
+        free(data->results);
+    }
+
+    if(data->tickets != NULL) {
+        free(data->tickets);
+    }
+
+    free(data);
+}
+
+static Result action_install_cdns_fetch_tmd(install_cdns_data* data, u32 index) {
+    Result res = 0;
+
+    http_stream stream;
+    if(R_SUCCEEDED(res = action_install_cdn_open_title_stream(data->tickets[index].titleId, "tmd", &stream))) {
+        u32 size = (u32) stream.size;
+
+        u8* tmd = NULL;
+        if(stream.size < 0x300 || stream.size > TMD_SIZE_MAX) {
+            res = R_FBI_OUT_OF_RANGE;
+        } else if((tmd = (u8*) calloc(1, size)) == NULL) {
+            res = R_FBI_OUT_OF_MEMORY;
+        }
+
+        while(R_SUCCEEDED(res) && stream.offset < size) {
+            if(data->cancel) {
+                res = R_FBI_CANCELLED;
+                break;
+            }
+
+            u32 bytesRead = 0;
+            res = http_stream_read(&stream, &bytesRead, tmd + stream.offset, size - (u32) stream.offset);
+        }
+
+        http_stream_close(&stream);
+
+        u32 contentCount = 0;
+        if(R_SUCCEEDED(res) && ((contentCount = util_get_tmd_content_count(tmd)) > CONTENTS_MAX
+                                || (u32) (util_get_tmd_content_chunk(tmd, contentCount) - tmd) > size)) {
+            res = R_FBI_OUT_OF_RANGE;
+        }
+
+        if(R_SUCCEEDED(res)) {
+            for(u32 i = 0; i < contentCount; i++) {
+                u64 contentSize = 0;
+                memcpy(&contentSize, &util_get_tmd_content_chunk(tmd, i)[0x08], sizeof(contentSize));
+                data->titleSizes[index] += __builtin_bswap64(contentSize);
+            }
+
+            data->tmds[index] = tmd;
+            data->tmdSizes[index] = size;
+        } else if(tmd != NULL) {
+            free(tmd);
+        }
+    }
+
+    return res;
+}
+
+static void action_install_cdns_thread(void* arg) {
+    install_cdns_data* data = (install_cdns_data*) arg;
+
+    for(u32 i = 0; i < data->count && !data->cancel; i++) {
+        if(R_SUCCEEDED(data->results[i] = action_install_cdns_fetch_tmd(data, i))) {
+            data->totalSize += data->titleSizes[i];
+        }
+
+        data->fetched = i + 1;
+    }
+
+    for(u32 i = 0; i < data->count && !data->cancel; i++) {
+        if(R_SUCCEEDED(data->results[i])) {
+            volatile bool done = false;
+            action_install_cdn_start(&done, &data->tickets[i], false, data, i);
+
+            while(!done) {
+                svcSleepThread(100000000);
+            }
+
+            free(data->tmds[i]);
+            data->tmds[i] = NULL;
+
+            if(data->results[i] == R_FBI_CANCELLED) {
+                data->cancel = true;
+            }
+        }
+
+        data->processedSize += data->titleSizes[i];
+        data->processed = i + 1;
+    }
+
+    data->finished = true;
+}
+
+static void action_install_cdns_draw_top(ui_view* view, void* data, float x1, float y1, float x2, float y2) {
+    install_cdns_data* installData = (install_cdns_data*) data;
+
+    u32 curr = installData->fetched < installData->count ? installData->fetched : installData->processed;
+    if(curr < installData->count) {
+        ui_draw_ticket_info(view, &installData->tickets[curr], x1, y1, x2, y2);
+    }
+}
+
+static void action_install_cdns_summary_onresponse(ui_view* view, void* data, bool response) {
+    action_install_cdns_free_data((install_cdns_data*) data);
+}
+
+static void action_install_cdns_update(ui_view* view, void* data, float* progress, char* text) {
+    install_cdns_data* installData = (install_cdns_data*) data;
+
+    if(installData->finished) {
+        ui_pop();
+        info_destroy(view);
+
+        u32 installed = 0;
+        u32 failed = 0;
+        for(u32 i = 0; i < installData->count; i++) {
+            if(i < installData->processed && R_SUCCEEDED(installData->results[i])) {
+                installed++;
+            }
+        }
+
+        size_t len = (size_t) snprintf(installData->summary, sizeof(installData->summary), "%s\nInstalled %lu of %lu titles.",
+                                       installData->cancel ? "Install cancelled." : "Install finished.", installed, installData->count);
+
+        for(u32 i = 0; i < installData->count && len < sizeof(installData->summary); i++) {
+            if(R_FAILED(installData->results[i]) && installData->results[i] != R_FBI_CANCELLED) {
+                if(failed < BATCH_FAILURES_SHOWN) {
+                    len += (size_t) snprintf(installData->summary + len, sizeof(installData->summary) - len, "%s%016llX: %08lX",
+                                             failed == 0 ? "\n\nFailed:\n" : "\n", installData->tickets[i].titleId, installData->results[i]);
+                }
+
+                failed++;
+            }
+        }
+
+        if(failed > BATCH_FAILURES_SHOWN && len < sizeof(installData->summary)) {
+            snprintf(installData->summary + len, sizeof(installData->summary) - len, "\n(%lu more)", failed - BATCH_FAILURES_SHOWN);
+        }
+
+        prompt_display(failed > 0 || installData->cancel ? "Failure" : "Success", installData->summary, COLOR_TEXT, false, installData, NULL, NULL, action_install_cdns_summary_onresponse);
+
+        return;
+    }
+
+    if(hidKeysDown() & KEY_B) {
+        installData->cancel = true;
+    }
+
+    if(installData->fetched < installData->count) {
+        *progress = (float) installData->fetched / (float) installData->count;
+        snprintf(text, PROGRESS_TEXT_MAX, "Fetching TMDs\n%lu / %lu", installData->fetched, installData->count);
+    } else {
+        *progress = installData->totalSize != 0 ? (float) ((double) installData->processedSize / (double) installData->totalSize) : 0;
+        snprintf(text, PROGRESS_TEXT_MAX, "%lu / %lu\n%.2f MiB / %.2f MiB", installData->processed, installData->count, installData->processedSize / 1024.0 / 1024.0, installData->totalSize / 1024.0 / 1024.0);
+    }
+}
+
+static void action_install_cdns_onresponse(ui_view* view, void* data, bool response) {
+    install_cdns_data* installData = (install_cdns_data*) data;
+
+    if(response) {
+        if(threadCreate(action_install_cdns_thread, installData, 0x10000, 0x18, 1, true) != NULL) {
+            info_display("Installing CDN Titles", "Press B to cancel.", true, data, action_install_cdns_update, action_install_cdns_draw_top);
+        } else {
+            error_display(NULL, NULL, NULL, "Failed to create CDN batch install thread.");
+
+            action_install_cdns_free_data(installData);
+        }
+    } else {
+        action_install_cdns_free_data(installData);
+    }
+}
+
+void action_install_cdns(linked_list* items, list_item* selected) {
+    install_cdns_data* data = (install_cdns_data*) calloc(1, sizeof(install_cdns_data));
+    if(data == NULL) {
+        error_display(NULL, NULL, NULL, "Failed to allocate install CDN batch data.");
+
+        return;
+    }
+
+    u32 size = linked_list_size(items);
+
+    // Copied, as the ticket list may be refreshed while the batch runs.
+    data->tickets = (ticket_info*) calloc(size, sizeof(ticket_info));
+    data->tmds = (u8**) calloc(size, sizeof(u8*));
+    data->tmdSizes = (u32*) calloc(size, sizeof(u32));
+    data->titleSizes = (u64*) calloc(size, sizeof(u64));
+    data->results = (Result*) calloc(size, sizeof(Result));
+    if(data->tickets == NULL || data->tmds == NULL || data->tmdSizes == NULL || data->titleSizes == NULL || data->results == NULL) {
+        error_display(NULL, NULL, NULL, "Failed to allocate install CDN batch data.");
+
+        action_install_cdns_free_data(data);
+        return;
+    }
+
+    linked_list_iter iter;
+    linked_list_iterate(items, &iter);
+
+    while(linked_list_iter_has_next(&iter)) {
+        list_item* item = (list_item*) linked_list_iter_next(&iter);
+        if(item->data != NULL) {
+            data->tickets[data->count++] = *(ticket_info*) item->data;
+        }
+    }
+
+    prompt_display("Confirmation", "Install all listed titles from the CDN?", COLOR_TEXT, true, data, NULL, NULL, action_install_cdns_onresponse);
+}
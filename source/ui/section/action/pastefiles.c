@@ -29,7 +29,7 @@ typedef struct {
 static void action_paste_files_draw_top(ui_view* view, void* data, float x1, float y1, float x2, float y2) {
     paste_files_data* pasteData = (paste_files_data*) data;
 
-    u32 curr = pasteData->pasteInfo.processed;
+    u32 curr = pasteData->pasteInfo.current;
     if(curr < pasteData->pasteInfo.total) {
         ui_draw_file_info(view, ((list_item*) linked_list_get(&pasteData->contents, curr))->data, x1, y1, x2, y2);
     } else if(pasteData->target != NULL) {
@@ -175,6 +175,42 @@ static Result action_paste_files_write_dst(void* data, u32 handle, u32* bytesWri
     return FSFILE_Write(handle, bytesWritten, offset, buffer, size, 0);
 }
 
+static Result action_paste_files_get_journal_id(void* data, u32 index, char* id, u32 size) {
+    paste_files_data* pasteData = (paste_files_data*) data;
+
+    char dstPath[FILE_PATH_MAX];
+    action_paste_files_get_dst_path(pasteData, index, dstPath);
+
+    snprintf(id, size, "%s -> %s", ((file_info*) ((list_item*) linked_list_get(&pasteData->contents, index))->data)->path, dstPath);
+    return 0;
+}
+
+static Result action_paste_files_reopen_dst(void* data, u32 index, u32* handle) {
+    paste_files_data* pasteData = (paste_files_data*) data;
+
+    Result res = 0;
+
+    char dstPath[FILE_PATH_MAX];
+    action_paste_files_get_dst_path(pasteData, index, dstPath);
+
+    FS_Path* fsPath = util_make_path_utf8(dstPath);
+    if(fsPath != NULL) {
+        pasteData->currExists = true;
+
+        res = FSUSER_OpenFile(handle, pasteData->target->archive, *fsPath, FS_OPEN_READ | FS_OPEN_WRITE, 0);
+
+        util_free_path_utf8(fsPath);
+    } else {
+        res = R_FBI_OUT_OF_MEMORY;
+    }
+
+    return res;
+}
+
+static Result action_paste_files_read_dst(void* data, u32 handle, u32* bytesRead, void* buffer, u64 offset, u32 size) {
+    return FSFILE_Read(handle, bytesRead, offset, buffer, size);
+}
+
 static bool action_paste_files_error(void* data, u32 index, Result res) {
     paste_files_data* pasteData = (paste_files_data*) data;
 
@@ -243,16 +279,31 @@ static void action_paste_files_update(ui_view* view, void* data, float* progress
     snprintf(text, PROGRESS_TEXT_MAX, "%lu / %lu\n%.2f MiB / %.2f MiB", pasteData->pasteInfo.processed, pasteData->pasteInfo.total, pasteData->pasteInfo.currProcessed / 1024.0 / 1024.0, pasteData->pasteInfo.currTotal / 1024.0 / 1024.0);
 }
 
+static void action_paste_files_start(paste_files_data* data) {
+    Result res = task_data_op(&data->pasteInfo);
+    if(R_SUCCEEDED(res)) {
+        info_display("Pasting Contents", "Press B to cancel.", true, data, action_paste_files_update, action_paste_files_draw_top);
+    } else {
+        error_display_res(NULL, data->target, ui_draw_file_info, res, "Failed to initiate paste operation.");
+
+        action_paste_files_free_data(data);
+    }
+}
+
+static void action_paste_files_resume_onresponse(ui_view* view, void* data, bool response) {
+    paste_files_data* pasteData = (paste_files_data*) data;
+
+    pasteData->pasteInfo.resume = response;
+    action_paste_files_start(pasteData);
+}
+
 static void action_paste_files_onresponse(ui_view* view, void* data, bool response) {
     paste_files_data* pasteData = (paste_files_data*) data;
     if(response) {
-        Result res = task_data_op(&pasteData->pasteInfo);
-        if(R_SUCCEEDED(res)) {
-            info_display("Pasting Contents", "Press B to cancel.", true, data, action_paste_files_update, action_paste_files_draw_top);
+        if(task_data_op_has_journal(&pasteData->pasteInfo)) {
+            prompt_display("Confirmation", "Resume the interrupted paste?", COLOR_TEXT, true, data, NULL, action_paste_files_draw_top, action_paste_files_resume_onresponse);
         } else {
-            error_display_res(NULL, pasteData->target, ui_draw_file_info, res, "Failed to initiate paste operation.");
-
-            action_paste_files_free_data(pasteData);
+            action_paste_files_start(pasteData);
         }
     } else {
         action_paste_files_free_data(pasteData);
@@ -293,6 +344,10 @@ void action_paste_contents(linked_list* items, list_item* selected) {
     data->pasteInfo.closeDst = action_paste_files_close_dst;
     data->pasteInfo.writeDst = action_paste_files_write_dst;
 
+    data->pasteInfo.getJournalId = action_paste_files_get_journal_id;
+    data->pasteInfo.reopenDst = action_paste_files_reopen_dst;
+    data->pasteInfo.readDst = action_paste_files_read_dst;
+
     data->pasteInfo.error = action_paste_files_error;
 
     data->pasteInfo.finished = true;
@@ -339,6 +394,7 @@ void action_paste_contents(linked_list* items, list_item* selected) {
 
     data->pasteInfo.total = linked_list_size(&data->contents);
     data->pasteInfo.processed = data->pasteInfo.total;
+    data->pasteInfo.current = data->pasteInfo.total;
 
     prompt_display("Confirmation", "Paste clipboard contents to the current directory?", COLOR_TEXT, true, data, NULL, action_paste_files_draw_top, action_paste_files_onresponse);
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include <malloc.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <3ds.h>
 
@@ -7,9 +8,49 @@
 #include "task/task.h"
 #include "../error.h"
 #include "../info.h"
+#include "../list.h"
 #include "../prompt.h"
 #include "../ui.h"
+#include "../../core/blockimage.h"
+#include "../../core/linkedlist.h"
 #include "../../core/screen.h"
+#include "../../core/sha256.h"
+#include "../../core/util.h"
+
+#define DUMPNAND_MODE_RAW 0
+#define DUMPNAND_MODE_COMPRESSED 1
+#define DUMPNAND_MODE_INCREMENTAL 2
+
+#define DUMPNAND_MANIFEST_PATH "/fbi/nand/manifest.dat"
+#define DUMPNAND_MANIFEST_TEMP_PATH "/fbi/nand/manifest.tmp"
+#define DUMPNAND_BASE_PATH "/fbi/nand/delta_0000.fbd"
+
+typedef struct {
+    u32 mode;
+    u64 imageSize;
+
+    // Compressed and incremental
+    u8* block;
+    u32 blockFill;
+    void* workspace;
+
+    blockimage_entry* index;
+    u32 blockCount;
+    u32 blockMax;
+
+    u64 fileOffset;
+
+    // Incremental
+    FS_Archive sdmcArchive;
+
+    u8* hashes;
+    u8* prevHashes;
+
+    u32 generation;
+    u32 recordCount;
+
+    data_op_data dumpInfo;
+} dump_nand_data;
 
 static Result dumpnand_is_src_directory(void* data, u32 index, bool* isDirectory) {
     *isDirectory = false;
@@ -29,28 +70,450 @@ static Result dumpnand_close_src(void* data, u32 index, bool succeeded, u32 hand
 }
 
 static Result dumpnand_get_src_size(void* data, u32 handle, u64* size) {
-    return FSFILE_GetSize(handle, size);
+    dump_nand_data* dumpData = (dump_nand_data*) data;
+
+    Result res = FSFILE_GetSize(handle, size);
+    if(R_SUCCEEDED(res)) {
+        dumpData->imageSize = *size;
+    }
+
+    return res;
 }
 
 static Result dumpnand_read_src(void* data, u32 handle, u32* bytesRead, void* buffer, u64 offset, u32 size) {
     return FSFILE_Read(handle, bytesRead, offset, buffer, size);
 }
 
+static void dumpnand_free_blocks(dump_nand_data* dumpData) {
+    if(dumpData->sdmcArchive != 0) {
+        FSUSER_CloseArchive(dumpData->sdmcArchive);
+        dumpData->sdmcArchive = 0;
+    }
+
+    if(dumpData->prevHashes != NULL) {
+        free(dumpData->prevHashes);
+        dumpData->prevHashes = NULL;
+    }
+
+    if(dumpData->hashes != NULL) {
+        free(dumpData->hashes);
+        dumpData->hashes = NULL;
+    }
+
+    if(dumpData->index != NULL) {
+        free(dumpData->index);
+        dumpData->index = NULL;
+    }
+
+    if(dumpData->workspace != NULL) {
+        free(dumpData->workspace);
+        dumpData->workspace = NULL;
+    }
+
+    if(dumpData->block != NULL) {
+        free(dumpData->block);
+        dumpData->block = NULL;
+    }
+}
+
+static Result dumpnand_write_file(u32 handle, u64 offset, const void* buffer, u32 size) {
+    Result res = 0;
+
+    u32 written = 0;
+    while(written < size) {
+        u32 bytesWritten = 0;
+        if(R_FAILED(res = FSFILE_Write(handle, &bytesWritten, offset + written, (const u8*) buffer + written, size - written, 0))) {
+            break;
+        }
+
+        written += bytesWritten;
+    }
+
+    return res;
+}
+
+static Result dumpnand_open_sd_file(dump_nand_data* dumpData, u32* handle, const char* path, u32 flags) {
+    Result res = 0;
+
+    FS_Path* fsPath = util_make_path_utf8(path);
+    if(fsPath != NULL) {
+        res = FSUSER_OpenFile(handle, dumpData->sdmcArchive, *fsPath, flags, 0);
+
+        util_free_path_utf8(fsPath);
+    } else {
+        res = R_FBI_OUT_OF_MEMORY;
+    }
+
+    return res;
+}
+
+// Loads the block hashes of the previous incremental dump. *found is set if
+// the manifest exists, and *usable if it also covers an image of this layout.
+static Result dumpnand_read_manifest(dump_nand_data* dumpData, const char* path, bool* found, bool* usable) {
+    *found = false;
+    *usable = false;
+
+    u32 handle = 0;
+    Result res = dumpnand_open_sd_file(dumpData, &handle, path, FS_OPEN_READ);
+    if(R_FAILED(res)) {
+        return res == R_FBI_OUT_OF_MEMORY ? res : 0;
+    }
+
+    *found = true;
+    res = 0;
+
+    blockimage_manifest_header header;
+    u32 hashesSize = dumpData->blockMax * SHA256_DIGEST_SIZE;
+
+    u32 bytesRead = 0;
+    if(R_SUCCEEDED(FSFILE_Read(handle, &bytesRead, 0, &header, sizeof(header))) && bytesRead == sizeof(header)
+       && header.magic == BLOCKIMAGE_MANIFEST_MAGIC && header.version == BLOCKIMAGE_VERSION && header.blockSize == BLOCKIMAGE_BLOCK_SIZE
+       && header.blockCount == dumpData->blockMax && header.imageSize == dumpData->imageSize) {
+        if((dumpData->prevHashes = (u8*) malloc(hashesSize)) == NULL) {
+            res = R_FBI_OUT_OF_MEMORY;
+        } else if(R_SUCCEEDED(FSFILE_Read(handle, &bytesRead, sizeof(header), dumpData->prevHashes, hashesSize)) && bytesRead == hashesSize) {
+            dumpData->generation = header.generation + 1;
+            *usable = true;
+        } else {
+            free(dumpData->prevHashes);
+            dumpData->prevHashes = NULL;
+        }
+    }
+
+    FSFILE_Close(handle);
+    return res;
+}
+
+// Whether a chain's first delta was completed; its header is written last.
+static bool dumpnand_has_base(dump_nand_data* dumpData) {
+    u32 handle = 0;
+    if(R_FAILED(dumpnand_open_sd_file(dumpData, &handle, DUMPNAND_BASE_PATH, FS_OPEN_READ))) {
+        return false;
+    }
+
+    blockimage_delta_header header;
+
+    u32 bytesRead = 0;
+    bool complete = R_SUCCEEDED(FSFILE_Read(handle, &bytesRead, 0, &header, sizeof(header))) && bytesRead == sizeof(header)
+                    && header.magic == BLOCKIMAGE_DELTA_MAGIC;
+
+    FSFILE_Close(handle);
+    return complete;
+}
+
+// Picks up the chain of the previous incremental dumps. A manifest.tmp without
+// a manifest.dat is a replacement cut short after the old manifest was
+// deleted; the temporary copy is complete by then. Without a usable manifest,
+// a new chain would overwrite the first delta of the one already on the SD
+// card, so the dump is refused instead.
+static Result dumpnand_load_chain(dump_nand_data* dumpData) {
+    Result res = 0;
+
+    bool found = false;
+    bool usable = false;
+    if(R_SUCCEEDED(res = dumpnand_read_manifest(dumpData, DUMPNAND_MANIFEST_PATH, &found, &usable)) && !found) {
+        res = dumpnand_read_manifest(dumpData, DUMPNAND_MANIFEST_TEMP_PATH, &found, &usable);
+    }
+
+    if(R_SUCCEEDED(res) && !usable && dumpnand_has_base(dumpData)) {
+        res = R_FBI_BACKUP_MISMATCH;
+    }
+
+    return res;
+}
+
+static Result dumpnand_open_delta(dump_nand_data* dumpData, u32* handle) {
+    Result res = 0;
+
+    if(R_FAILED(res = FSUSER_OpenArchive(&dumpData->sdmcArchive, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, "")))) {
+        dumpData->sdmcArchive = 0;
+        return res;
+    }
+
+    if(R_FAILED(res = util_ensure_dir(dumpData->sdmcArchive, "/fbi/")) || R_FAILED(res = util_ensure_dir(dumpData->sdmcArchive, "/fbi/nand/"))) {
+        return res;
+    }
+
+    if((dumpData->hashes = (u8*) calloc(dumpData->blockMax, SHA256_DIGEST_SIZE)) == NULL) {
+        return R_FBI_OUT_OF_MEMORY;
+    }
+
+    dumpData->generation = 0;
+    dumpData->recordCount = 0;
+    dumpData->fileOffset = sizeof(blockimage_delta_header);
+
+    if(R_FAILED(res = dumpnand_load_chain(dumpData))) {
+        return res;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/fbi/nand/delta_%04lu.fbd", dumpData->generation);
+
+    if(R_SUCCEEDED(res = dumpnand_open_sd_file(dumpData, handle, path, FS_OPEN_WRITE | FS_OPEN_CREATE)) && R_FAILED(res = FSFILE_SetSize(*handle, 0))) {
+        FSFILE_Close(*handle);
+    }
+
+    return res;
+}
+
 static Result dumpnand_open_dst(void* data, u32 index, void* initialReadBlock, u32* handle) {
-    return FSUSER_OpenFileDirectly(handle, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, ""), fsMakePath(PATH_UTF16, u"/NAND.bin"), FS_OPEN_WRITE | FS_OPEN_CREATE, 0);
+    dump_nand_data* dumpData = (dump_nand_data*) data;
+
+    if(dumpData->mode == DUMPNAND_MODE_RAW) {
+        return FSUSER_OpenFileDirectly(handle, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, ""), fsMakePath(PATH_UTF16, u"/NAND.bin"), FS_OPEN_WRITE | FS_OPEN_CREATE, 0);
+    }
+
+    Result res = 0;
+
+    dumpData->blockFill = 0;
+    dumpData->blockCount = 0;
+    dumpData->blockMax = blockimage_block_count(dumpData->imageSize, BLOCKIMAGE_BLOCK_SIZE);
+    dumpData->fileOffset = sizeof(blockimage_header);
+
+    if((dumpData->block = (u8*) malloc(BLOCKIMAGE_BLOCK_SIZE)) != NULL
+       && (dumpData->workspace = malloc(BLOCKIMAGE_WORKSPACE_SIZE(BLOCKIMAGE_BLOCK_SIZE))) != NULL
+       && (dumpData->mode != DUMPNAND_MODE_COMPRESSED || (dumpData->index = (blockimage_entry*) calloc(dumpData->blockMax + 1, sizeof(blockimage_entry))) != NULL)) {
+        if(dumpData->mode == DUMPNAND_MODE_INCREMENTAL) {
+            res = dumpnand_open_delta(dumpData, handle);
+        } else if(R_SUCCEEDED(res = FSUSER_OpenFileDirectly(handle, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, ""), fsMakePath(PATH_UTF16, u"/NAND.fbz"), FS_OPEN_WRITE | FS_OPEN_CREATE, 0))
+           && R_FAILED(res = FSFILE_SetSize(*handle, 0))) {
+            FSFILE_Close(*handle);
+        }
+    } else {
+        res = R_FBI_OUT_OF_MEMORY;
+    }
+
+    if(R_FAILED(res)) {
+        dumpnand_free_blocks(dumpData);
+    }
+
+    return res;
+}
+
+// Incremental dumps only store blocks whose hash differs from the manifest.
+static Result dumpnand_flush_delta_block(dump_nand_data* dumpData, u32 handle) {
+    Result res = 0;
+
+    u32 block = dumpData->blockCount;
+    u8* hash = &dumpData->hashes[block * SHA256_DIGEST_SIZE];
+
+    sha256(dumpData->block, dumpData->blockFill, hash);
+
+    if(dumpData->prevHashes == NULL || memcmp(hash, &dumpData->prevHashes[block * SHA256_DIGEST_SIZE], SHA256_DIGEST_SIZE) != 0) {
+        blockimage_delta_record record;
+        record.block = block;
+
+        const u8* packed = NULL;
+        record.size = blockimage_pack(dumpData->block, dumpData->blockFill, dumpData->workspace, &packed);
+
+        if(R_FAILED(res = dumpnand_write_file(handle, dumpData->fileOffset, &record, sizeof(record)))
+           || R_FAILED(res = dumpnand_write_file(handle, dumpData->fileOffset + sizeof(record), packed, record.size))) {
+            return res;
+        }
+
+        dumpData->fileOffset += sizeof(record) + record.size;
+        dumpData->recordCount++;
+    }
+
+    dumpData->blockCount++;
+    dumpData->blockFill = 0;
+
+    return res;
+}
+
+static Result dumpnand_flush_block(dump_nand_data* dumpData, u32 handle) {
+    if(dumpData->blockCount >= dumpData->blockMax) {
+        return R_FBI_OUT_OF_RANGE;
+    }
+
+    if(dumpData->mode == DUMPNAND_MODE_INCREMENTAL) {
+        return dumpnand_flush_delta_block(dumpData, handle);
+    }
+
+    Result res = 0;
+
+    const u8* packed = NULL;
+    u32 packedSize = blockimage_pack(dumpData->block, dumpData->blockFill, dumpData->workspace, &packed);
+
+    if(R_SUCCEEDED(res = dumpnand_write_file(handle, dumpData->fileOffset, packed, packedSize))) {
+        blockimage_entry* entry = &dumpData->index[dumpData->blockCount++];
+        entry->offset = dumpData->fileOffset;
+        entry->size = packedSize;
+
+        dumpData->fileOffset += packedSize;
+        dumpData->blockFill = 0;
+    }
+
+    return res;
+}
+
+static Result dumpnand_finish_compressed(dump_nand_data* dumpData, u32 handle) {
+    Result res = 0;
+
+    blockimage_header header;
+    header.magic = BLOCKIMAGE_MAGIC;
+    header.version = BLOCKIMAGE_VERSION;
+    header.blockSize = BLOCKIMAGE_BLOCK_SIZE;
+    header.blockCount = dumpData->blockCount;
+    header.imageSize = dumpData->imageSize;
+    header.indexOffset = dumpData->fileOffset;
+
+    if(R_SUCCEEDED(res = dumpnand_write_file(handle, header.indexOffset, dumpData->index, dumpData->blockCount * sizeof(blockimage_entry)))) {
+        res = dumpnand_write_file(handle, 0, &header, sizeof(header));
+    }
+
+    return res;
+}
+
+// Replaces the manifest with the one just written to its temporary path.
+static Result dumpnand_commit_manifest(dump_nand_data* dumpData) {
+    Result res = R_FBI_OUT_OF_MEMORY;
+
+    FS_Path* srcFsPath = util_make_path_utf8(DUMPNAND_MANIFEST_TEMP_PATH);
+    if(srcFsPath != NULL) {
+        FS_Path* dstFsPath = util_make_path_utf8(DUMPNAND_MANIFEST_PATH);
+        if(dstFsPath != NULL) {
+            FSUSER_DeleteFile(dumpData->sdmcArchive, *dstFsPath);
+            res = FSUSER_RenameFile(dumpData->sdmcArchive, *srcFsPath, dumpData->sdmcArchive, *dstFsPath);
+
+            util_free_path_utf8(dstFsPath);
+        }
+
+        util_free_path_utf8(srcFsPath);
+    }
+
+    return res;
+}
+
+// The manifest is only replaced once its delta is complete, and then by
+// renaming a complete copy into place; its header, like the delta's, goes in
+// last. A dump cut short at any point leaves the previous chain usable.
+static Result dumpnand_finish_incremental(dump_nand_data* dumpData, u32 handle) {
+    Result res = 0;
+
+    blockimage_delta_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = BLOCKIMAGE_DELTA_MAGIC;
+    header.version = BLOCKIMAGE_VERSION;
+    header.blockSize = BLOCKIMAGE_BLOCK_SIZE;
+    header.recordCount = dumpData->recordCount;
+    header.imageSize = dumpData->imageSize;
+    header.generation = dumpData->generation;
+
+    if(R_FAILED(res = dumpnand_write_file(handle, 0, &header, sizeof(header)))) {
+        return res;
+    }
+
+    blockimage_manifest_header manifest;
+    memset(&manifest, 0, sizeof(manifest));
+    manifest.magic = BLOCKIMAGE_MANIFEST_MAGIC;
+    manifest.version = BLOCKIMAGE_VERSION;
+    manifest.blockSize = BLOCKIMAGE_BLOCK_SIZE;
+    manifest.blockCount = dumpData->blockCount;
+    manifest.imageSize = dumpData->imageSize;
+    manifest.generation = dumpData->generation;
+
+    u32 manifestHandle = 0;
+    if(R_SUCCEEDED(res = dumpnand_open_sd_file(dumpData, &manifestHandle, DUMPNAND_MANIFEST_TEMP_PATH, FS_OPEN_WRITE | FS_OPEN_CREATE))) {
+        if(R_SUCCEEDED(res = FSFILE_SetSize(manifestHandle, 0))
+           && R_SUCCEEDED(res = dumpnand_write_file(manifestHandle, sizeof(manifest), dumpData->hashes, dumpData->blockCount * SHA256_DIGEST_SIZE))) {
+            res = dumpnand_write_file(manifestHandle, 0, &manifest, sizeof(manifest));
+        }
+
+        Result closeRes = FSFILE_Close(manifestHandle);
+        if(R_SUCCEEDED(res)) {
+            res = closeRes;
+        }
+    }
+
+    if(R_SUCCEEDED(res)) {
+        res = dumpnand_commit_manifest(dumpData);
+    }
+
+    return res;
 }
 
 static Result dumpnand_close_dst(void* data, u32 index, bool succeeded, u32 handle) {
-    return FSFILE_Close(handle);
+    dump_nand_data* dumpData = (dump_nand_data*) data;
+
+    if(dumpData->mode == DUMPNAND_MODE_RAW) {
+        return FSFILE_Close(handle);
+    }
+
+    Result res = 0;
+
+    // The header goes in last, so an interrupted dump is never mistaken for a complete one.
+    if(succeeded && (dumpData->blockFill == 0 || R_SUCCEEDED(res = dumpnand_flush_block(dumpData, handle)))) {
+        if(dumpData->mode == DUMPNAND_MODE_INCREMENTAL) {
+            res = dumpnand_finish_incremental(dumpData, handle);
+        } else {
+            res = dumpnand_finish_compressed(dumpData, handle);
+        }
+    }
+
+    Result closeRes = FSFILE_Close(handle);
+    if(R_SUCCEEDED(res)) {
+        res = closeRes;
+    }
+
+    dumpnand_free_blocks(dumpData);
+
+    return res;
 }
 
 static Result dumpnand_write_dst(void* data, u32 handle, u32* bytesWritten, void* buffer, u64 offset, u32 size) {
-    return FSFILE_Write(handle, bytesWritten, offset, buffer, size, 0);
+    dump_nand_data* dumpData = (dump_nand_data*) data;
+
+    if(dumpData->mode == DUMPNAND_MODE_RAW) {
+        return FSFILE_Write(handle, bytesWritten, offset, buffer, size, 0);
+    }
+
+    Result res = 0;
+
+    u32 currSize = BLOCKIMAGE_BLOCK_SIZE - dumpData->blockFill;
+    if(currSize > size) {
+        currSize = size;
+    }
+
+    memcpy(dumpData->block + dumpData->blockFill, buffer, currSize);
+    dumpData->blockFill += currSize;
+
+    if(dumpData->blockFill == BLOCKIMAGE_BLOCK_SIZE) {
+        res = dumpnand_flush_block(dumpData, handle);
+    }
+
+    *bytesWritten = R_SUCCEEDED(res) ? currSize : 0;
+    return res;
+}
+
+// Written in sha256sum's format, so the dump can be checked with "sha256sum -c".
+static Result dumpnand_hash_dst(void* data, u32 index, u8* sha256, u32 crc32) {
+    char text[SHA256_DIGEST_SIZE * 2 + 16];
+    for(u32 i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        snprintf(&text[i * 2], 3, "%02x", sha256[i]);
+    }
+
+    snprintf(&text[SHA256_DIGEST_SIZE * 2], sizeof(text) - SHA256_DIGEST_SIZE * 2, "  NAND.bin\n");
+
+    Result res = 0;
+
+    u32 handle = 0;
+    if(R_SUCCEEDED(res = FSUSER_OpenFileDirectly(&handle, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, ""), fsMakePath(PATH_UTF16, u"/NAND.bin.sha256"), FS_OPEN_WRITE | FS_OPEN_CREATE, 0))) {
+        if(R_SUCCEEDED(res = FSFILE_SetSize(handle, 0))) {
+            res = dumpnand_write_file(handle, 0, text, strlen(text));
+        }
+
+        FSFILE_Close(handle);
+    }
+
+    return res;
 }
 
 static bool dumpnand_error(void* data, u32 index, Result res) {
     if(res == R_FBI_CANCELLED) {
         prompt_display("Failure", "Dump cancelled.", COLOR_TEXT, false, NULL, NULL, NULL, NULL);
+    } else if(res == R_FBI_BACKUP_MISMATCH) {
+        error_display(NULL, NULL, NULL, "Failed to dump NAND.\nThe backup in /fbi/nand/ has no usable manifest\nfor this NAND. Move it aside to start a new one.");
     } else {
         error_display_res(NULL, NULL, NULL, res, "Failed to dump NAND.");
     }
@@ -59,13 +522,13 @@ static bool dumpnand_error(void* data, u32 index, Result res) {
 }
 
 static void dumpnand_update(ui_view* view, void* data, float* progress, char* text) {
-    data_op_data* dumpData = (data_op_data*) data;
+    dump_nand_data* dumpData = (dump_nand_data*) data;
 
-    if(dumpData->finished) {
+    if(dumpData->dumpInfo.finished) {
         ui_pop();
         info_destroy(view);
 
-        if(R_SUCCEEDED(dumpData->result)) {
+        if(R_SUCCEEDED(dumpData->dumpInfo.result)) {
             prompt_display("Success", "NAND dumped.", COLOR_TEXT, false, NULL, NULL, NULL, NULL);
         }
 
@@ -75,18 +538,18 @@ static void dumpnand_update(ui_view* view, void* data, float* progress, char* te
     }
 
     if(hidKeysDown() & KEY_B) {
-        svcSignalEvent(dumpData->cancelEvent);
+        svcSignalEvent(dumpData->dumpInfo.cancelEvent);
     }
 
-    *progress = dumpData->currTotal != 0 ? (float) ((double) dumpData->currProcessed / (double) dumpData->currTotal) : 0;
-    snprintf(text, PROGRESS_TEXT_MAX, "%.2f MiB / %.2f MiB", dumpData->currProcessed / 1024.0f / 1024.0f, dumpData->currTotal / 1024.0f / 1024.0f);
+    *progress = dumpData->dumpInfo.currTotal != 0 ? (float) ((double) dumpData->dumpInfo.currProcessed / (double) dumpData->dumpInfo.currTotal) : 0;
+    snprintf(text, PROGRESS_TEXT_MAX, "%.2f MiB / %.2f MiB", dumpData->dumpInfo.currProcessed / 1024.0f / 1024.0f, dumpData->dumpInfo.currTotal / 1024.0f / 1024.0f);
 }
 
 static void dumpnand_onresponse(ui_view* view, void* data, bool response) {
     if(response) {
-        data_op_data* dumpData = (data_op_data*) data;
+        dump_nand_data* dumpData = (dump_nand_data*) data;
 
-        Result res = task_data_op(dumpData);
+        Result res = task_data_op(&dumpData->dumpInfo);
         if(R_SUCCEEDED(res)) {
             info_display("Dumping NAND", "Press B to cancel.", true, data, dumpnand_update, NULL);
         } else {
@@ -97,37 +560,94 @@ static void dumpnand_onresponse(ui_view* view, void* data, bool response) {
     }
 }
 
-void dumpnand_open() {
-    data_op_data* data = (data_op_data*) calloc(1, sizeof(data_op_data));
+static void dumpnand_start(u32 mode) {
+    dump_nand_data* data = (dump_nand_data*) calloc(1, sizeof(dump_nand_data));
     if(data == NULL) {
         error_display(NULL, NULL, NULL, "Failed to allocate dump NAND data.");
 
         return;
     }
 
-    data->data = data;
+    data->mode = mode;
 
-    data->op = DATAOP_COPY;
+    data->dumpInfo.data = data;
 
-    data->copyEmpty = true;
+    data->dumpInfo.op = DATAOP_COPY;
 
-    data->total = 1;
+    data->dumpInfo.copyEmpty = true;
 
-    data->isSrcDirectory = dumpnand_is_src_directory;
-    data->makeDstDirectory = dumpnand_make_dst_directory;
+    data->dumpInfo.total = 1;
 
-    data->openSrc = dumpnand_open_src;
-    data->closeSrc = dumpnand_close_src;
-    data->getSrcSize = dumpnand_get_src_size;
-    data->readSrc = dumpnand_read_src;
+    data->dumpInfo.isSrcDirectory = dumpnand_is_src_directory;
+    data->dumpInfo.makeDstDirectory = dumpnand_make_dst_directory;
 
-    data->openDst = dumpnand_open_dst;
-    data->closeDst = dumpnand_close_dst;
-    data->writeDst = dumpnand_write_dst;
+    data->dumpInfo.openSrc = dumpnand_open_src;
+    data->dumpInfo.closeSrc = dumpnand_close_src;
+    data->dumpInfo.getSrcSize = dumpnand_get_src_size;
+    data->dumpInfo.readSrc = dumpnand_read_src;
 
-    data->error = dumpnand_error;
+    data->dumpInfo.openDst = dumpnand_open_dst;
+    data->dumpInfo.closeDst = dumpnand_close_dst;
+    data->dumpInfo.writeDst = dumpnand_write_dst;
 
-    data->finished = true;
+    // Only a raw image matches a digest of the NAND itself. Dumps are never
+    // resumed: the NAND keeps changing under the running system, so the two
+    // halves of a resumed image would not belong to the same NAND state.
+    if(mode == DUMPNAND_MODE_RAW) {
+        data->dumpInfo.hashDst = dumpnand_hash_dst;
+    }
+
+    data->dumpInfo.error = dumpnand_error;
+
+    data->dumpInfo.finished = true;
+
+    static const char* confirmations[] = {"Dump raw NAND image to the SD card?", "Dump compressed NAND image to the SD card?", "Back up changed NAND blocks to the SD card?"};
+
+    prompt_display("Confirmation", confirmations[mode], COLOR_TEXT, true, data, NULL, NULL, dumpnand_onresponse);
+}
 
-    prompt_display("Confirmation", "Dump raw NAND image to the SD card?", COLOR_TEXT, true, data, NULL, NULL, dumpnand_onresponse);
+static void dumpnand_open_raw() {
+    dumpnand_start(DUMPNAND_MODE_RAW);
+}
+
+static void dumpnand_open_compressed() {
+    dumpnand_start(DUMPNAND_MODE_COMPRESSED);
+}
+
+static void dumpnand_open_incremental() {
+    dumpnand_start(DUMPNAND_MODE_INCREMENTAL);
+}
+
+static list_item raw_image = {"Raw Image (NAND.bin)", COLOR_TEXT, dumpnand_open_raw};
+static list_item compressed_image = {"Compressed Image (NAND.fbz)", COLOR_TEXT, dumpnand_open_compressed};
+static list_item incremental_image = {"Incremental Backup (/fbi/nand/)", COLOR_TEXT, dumpnand_open_incremental};
+
+static void dumpnand_mode_update(ui_view* view, void* data, linked_list* items, list_item* selected, bool selectedTouched) {
+    if(hidKeysDown() & KEY_B) {
+        ui_pop();
+        list_destroy(view);
+
+        return;
+    }
+
+    if(selected != NULL && selected->data != NULL && (selectedTouched || (hidKeysDown() & KEY_A))) {
+        void(*start)() = (void(*)()) selected->data;
+
+        ui_pop();
+        list_destroy(view);
+
+        start();
+
+        return;
+    }
+
+    if(linked_list_size(items) == 0) {
+        linked_list_add(items, &raw_image);
+        linked_list_add(items, &compressed_image);
+        linked_list_add(items, &incremental_image);
+    }
+}
+
+void dumpnand_open() {
+    list_display("Dump NAND", "A: Select, B: Return", NULL, dumpnand_mode_update, NULL);
 }
\ No newline at end of file
@@ -16,13 +16,40 @@
 #include "../info.h"
 #include "../prompt.h"
 #include "../ui.h"
+#include "../../core/lz4.h"
 #include "../../core/screen.h"
 #include "../../core/util.h"
 
+// Protocol v2 senders open with this word where v1 sends the file count.
+// They follow it with a version, flags and the file count, then stream
+// size-prefixed files back-to-back, keeping up to the negotiated window of
+// files unacknowledged. Each installed file is acked with a 1 as it
+// completes; a 0 ends the session.
+#define PROTOCOL_MAGIC 0x46424932
+#define PROTOCOL_VERSION 2
+#define PROTOCOL_FLAGS (PROTOCOL_FLAG_LZ4)
+#define PROTOCOL_WINDOW 8
+
+// File data is sent as frames of a big-endian raw and packed size followed by
+// the packed bytes, LZ4 compressed unless both sizes match. Frames expand to
+// at most PROTOCOL_FRAME_MAX bytes and never span files.
+#define PROTOCOL_FLAG_LZ4 0x1
+#define PROTOCOL_FRAME_MAX (64 * 1024)
+
 typedef struct {
     int serverSocket;
     int clientSocket;
 
+    u32 version;
+    u32 flags;
+
+    // Compressed framing; frames too large for the read are expanded here first.
+    u64 srcSize;
+    u8* packed;
+    u8* frame;
+    u32 frameSize;
+    u32 frameOffset;
+
     u64 currTitleId;
     u64 startTime;
     u8 productCode[0x10 + 1];
@@ -34,10 +61,6 @@ typedef struct {
     data_op_data installInfo;
 } network_install_data;
 
-static u32 soc_bufferSize = 1024 * 256;
-static u8* soc_buffer = NULL;
-static u32 soc_bufferpos = 0;
-
 static int recvwait(int sockfd, void* buf, size_t len, int flags) {
     errno = 0;
 
@@ -62,6 +85,59 @@ static int sendwait(int sockfd, void* buf, size_t len, int flags) {
     return ret < 0 ? ret : (int) written;
 }
 
+// Receives whatever has arrived, waiting briefly for the first bytes.
+static Result networkinstall_recv_some(network_install_data* data, void* buf, u32 size, u32* bytesRead) {
+    *bytesRead = 0;
+
+    struct pollfd pollInfo;
+    pollInfo.fd = data->clientSocket;
+    pollInfo.events = POLLIN;
+    pollInfo.revents = 0;
+
+    errno = 0;
+    int ready = poll(&pollInfo, 1, 10);
+    if(ready == 0 || (ready < 0 && errno == EAGAIN)) {
+        return 0;
+    }
+
+    int ret = ready < 0 ? ready : recv(data->clientSocket, buf, size, 0);
+    if(ret < 0 && errno == EAGAIN) {
+        return 0;
+    }
+
+    if(ret <= 0) {
+        if(ret == 0) {
+            errno = ECONNRESET;
+        }
+
+        return R_FBI_ERRNO;
+    }
+
+    *bytesRead = (u32) ret;
+    return 0;
+}
+
+static Result networkinstall_recv_all(network_install_data* data, void* buf, u32 size) {
+    Result res = 0;
+
+    u32 read = 0;
+    while(read < size) {
+        if(task_is_quit_all() || svcWaitSynchronization(data->installInfo.cancelEvent, 0) == 0) {
+            res = R_FBI_CANCELLED;
+            break;
+        }
+
+        u32 bytesRead = 0;
+        if(R_FAILED(res = networkinstall_recv_some(data, (u8*) buf + read, size - read, &bytesRead))) {
+            break;
+        }
+
+        read += bytesRead;
+    }
+
+    return res;
+}
+
 static Result networkinstall_is_src_directory(void* data, u32 index, bool* isDirectory) {
     *isDirectory = false;
     return 0;
@@ -71,42 +147,125 @@ static Result networkinstall_make_dst_directory(void* data, u32 index) {
     return 0;
 }
 
+static Result networkinstall_send_ack(network_install_data* data) {
+    u8 ack = 1;
+    if(sendwait(data->clientSocket, &ack, sizeof(ack), 0) < 0) {
+        return R_FBI_ERRNO;
+    }
+
+    return 0;
+}
+
+// v1 senders wait for an ack before each file.
 static Result networkinstall_open_src(void* data, u32 index, u32* handle) {
     network_install_data* networkInstallData = (network_install_data*) data;
 
-    u8 ack = 1;
-    if(sendwait(networkInstallData->clientSocket, &ack, sizeof(ack), 0) < 0) {
-        return R_FBI_ERRNO;
+    if(networkInstallData->version < 2) {
+        return networkinstall_send_ack(networkInstallData);
     }
 
     return 0;
 }
 
+// v2 senders are already streaming the next files; the ack only slides the window.
 static Result networkinstall_close_src(void* data, u32 index, bool succeeded, u32 handle) {
+    network_install_data* networkInstallData = (network_install_data*) data;
+
+    if(networkInstallData->version >= 2 && succeeded) {
+        return networkinstall_send_ack(networkInstallData);
+    }
+
     return 0;
 }
 
 static Result networkinstall_get_src_size(void* data, u32 handle, u64* size) {
     network_install_data* networkInstallData = (network_install_data*) data;
 
+    Result res = 0;
+
     u64 netSize = 0;
-    if(recvwait(networkInstallData->clientSocket, &netSize, sizeof(netSize), 0) < 0) {
-        return R_FBI_ERRNO;
+    if(R_SUCCEEDED(res = networkinstall_recv_all(networkInstallData, &netSize, sizeof(netSize)))) {
+        *size = __builtin_bswap64(netSize);
+
+        networkInstallData->srcSize = *size;
+        networkInstallData->frameSize = 0;
+        networkInstallData->frameOffset = 0;
     }
 
-    soc_bufferpos = 0;
-    if(soc_buffer==NULL) soc_buffer = (u8*) calloc(1, soc_bufferSize);
+    return res;
+}
 
-    *size = __builtin_bswap64(netSize);
-    return 0;
+// Expands the next frame, straight into the copy engine's buffer when it fits.
+static Result networkinstall_read_frame(network_install_data* data, u32* bytesRead, void* buffer, u64 offset, u32 size) {
+    if(data->packed == NULL && (data->packed = (u8*) calloc(1, LZ4_COMPRESS_BOUND(PROTOCOL_FRAME_MAX))) == NULL) {
+        return R_FBI_OUT_OF_MEMORY;
+    }
+
+    if(data->frame == NULL && (data->frame = (u8*) calloc(1, PROTOCOL_FRAME_MAX)) == NULL) {
+        return R_FBI_OUT_OF_MEMORY;
+    }
+
+    Result res = 0;
+
+    u32 header[2];
+    if(R_FAILED(res = networkinstall_recv_all(data, header, sizeof(header)))) {
+        return res;
+    }
+
+    u32 rawSize = ntohl(header[0]);
+    u32 packedSize = ntohl(header[1]);
+    if(rawSize == 0 || rawSize > PROTOCOL_FRAME_MAX || rawSize > data->srcSize - offset || packedSize == 0 || packedSize > LZ4_COMPRESS_BOUND(PROTOCOL_FRAME_MAX)) {
+        return R_FBI_OUT_OF_RANGE;
+    }
+
+    u8* dst = rawSize <= size ? (u8*) buffer : data->frame;
+
+    if(packedSize == rawSize) {
+        res = networkinstall_recv_all(data, dst, rawSize);
+    } else if(R_SUCCEEDED(res = networkinstall_recv_all(data, data->packed, packedSize))
+              && lz4_decompress(data->packed, packedSize, dst, rawSize) != (s32) rawSize) {
+        res = R_FBI_OUT_OF_RANGE;
+    }
+
+    if(R_SUCCEEDED(res)) {
+        if(dst == buffer) {
+            *bytesRead = rawSize;
+        } else {
+            data->frameSize = rawSize;
+            data->frameOffset = 0;
+        }
+    }
+
+    return res;
 }
 
+// Receives straight into the copy engine's buffer. Reads never run past the
+// requested size, so the next file's size prefix stays on the socket.
 static Result networkinstall_read_src(void* data, u32 handle, u32* bytesRead, void* buffer, u64 offset, u32 size) {
-    if(soc_buffer != NULL && soc_bufferpos>0){
-        memcpy(buffer, soc_buffer, soc_bufferpos);
-        *bytesRead = (u32) soc_bufferpos;
-        soc_bufferpos = 0;
+    network_install_data* networkInstallData = (network_install_data*) data;
+
+    if(!(networkInstallData->flags & PROTOCOL_FLAG_LZ4)) {
+        return networkinstall_recv_some(networkInstallData, buffer, size, bytesRead);
     }
+
+    *bytesRead = 0;
+
+    if(networkInstallData->frameOffset == networkInstallData->frameSize) {
+        Result res = networkinstall_read_frame(networkInstallData, bytesRead, buffer, offset, size);
+        if(R_FAILED(res) || *bytesRead > 0) {
+            return res;
+        }
+    }
+
+    u32 remaining = networkInstallData->frameSize - networkInstallData->frameOffset;
+    if(size > remaining) {
+        size = remaining;
+    }
+
+    memcpy(buffer, networkInstallData->frame + networkInstallData->frameOffset, size);
+    networkInstallData->frameOffset += size;
+
+    *bytesRead = size;
     return 0;
 }
 
@@ -231,6 +390,16 @@ static void networkinstall_close_client(network_install_data* data) {
         data->clientSocket = 0;
     }
 
+    if(data->packed != NULL) {
+        free(data->packed);
+        data->packed = NULL;
+    }
+
+    if(data->frame != NULL) {
+        free(data->frame);
+        data->frame = NULL;
+    }
+
     data->currTitleId = 0;
 }
 
@@ -265,21 +434,41 @@ static void networkinstall_install_update(ui_view* view, void* data, float* prog
         svcSignalEvent(networkInstallData->installInfo.cancelEvent);
     }
 
-    if(soc_buffer != NULL && soc_bufferpos == 0)
-        soc_bufferpos = recvwait(networkInstallData->clientSocket, soc_buffer, soc_bufferSize, 0);
-
     *progress = networkInstallData->installInfo.currTotal != 0 ? (float) ((double) networkInstallData->installInfo.currProcessed / (double) networkInstallData->installInfo.currTotal) : 0;
-    float speed = networkInstallData->installInfo.currProcessed / (osGetTime() - networkInstallData->startTime) / 1048.5f;
-    snprintf(text, PROGRESS_TEXT_MAX, "%lu / %lu\n%s: %.2f MiB / %.2f MiB\nSpeed: %.3f MiB/s", networkInstallData->installInfo.processed, networkInstallData->installInfo.total, 
+    u64 elapsed = osGetTime() - networkInstallData->startTime;
+    float speed = elapsed != 0 ? networkInstallData->installInfo.currProcessed / elapsed / 1048.5f : 0;
+    snprintf(text, PROGRESS_TEXT_MAX, "%lu / %lu\n%s: %.2f MiB / %.2f MiB\nSpeed: %.3f MiB/s", (unsigned long) networkInstallData->installInfo.processed, (unsigned long) networkInstallData->installInfo.total,
         (char*)networkInstallData->productCode, networkInstallData->installInfo.currProcessed / 1024.0 / 1024.0, networkInstallData->installInfo.currTotal / 1024.0 / 1024.0, speed);
 }
 
+// Accepts a v2 session; the sender waits for this reply before streaming.
+static Result networkinstall_send_hello(network_install_data* data) {
+    if(data->version < 2) {
+        return 0;
+    }
+
+    u32 hello[4] = {htonl(PROTOCOL_MAGIC), htonl(data->version), htonl(data->flags), htonl(PROTOCOL_WINDOW)};
+    if(sendwait(data->clientSocket, hello, sizeof(hello), 0) < 0) {
+        return R_FBI_ERRNO;
+    }
+
+    return 0;
+}
+
 static void networkinstall_cdn_check_onresponse(ui_view* view, void* data, bool response) {
     network_install_data* networkInstallData = (network_install_data*) data;
 
     networkInstallData->cdn = response;
 
-    Result res = task_data_op(&networkInstallData->installInfo);
+    Result res = networkinstall_send_hello(networkInstallData);
+    if(R_FAILED(res)) {
+        error_display_errno(NULL, NULL, NULL, errno, "Failed to accept connection.");
+
+        networkinstall_close_client(networkInstallData);
+        return;
+    }
+
+    res = task_data_op(&networkInstallData->installInfo);
     if(R_SUCCEEDED(res)) {
         info_display("Installing Received Files", "Long Press B to cancel.", true, data, networkinstall_install_update, NULL);
     } else {
@@ -322,6 +511,32 @@ static void networkinstall_wait_update(ui_view* view, void* data, float* progres
         }
 
         networkInstallData->installInfo.total = ntohl(networkInstallData->installInfo.total);
+        networkInstallData->version = 1;
+        networkInstallData->flags = 0;
+
+        if(networkInstallData->installInfo.total == PROTOCOL_MAGIC) {
+            u32 hello[3];
+            if(recvwait(sock, hello, sizeof(hello), 0) < 0) {
+                close(sock);
+
+                error_display_errno(NULL, NULL, NULL, errno, "Failed to read protocol header.");
+                return;
+            }
+
+            // Only v2 and later open with the magic; anything else would
+            // wait forever for a reply this side never sends.
+            u32 version = ntohl(hello[0]);
+            if(version < 2) {
+                close(sock);
+
+                error_display(NULL, NULL, NULL, "Unsupported protocol version: %lu", version);
+                return;
+            }
+
+            networkInstallData->version = version < PROTOCOL_VERSION ? version : PROTOCOL_VERSION;
+            networkInstallData->flags = ntohl(hello[1]) & PROTOCOL_FLAGS;
+            networkInstallData->installInfo.total = ntohl(hello[2]);
+        }
 
         networkInstallData->clientSocket = sock;
         prompt_display("Confirmation", "Install the received file(s)?", COLOR_TEXT, true, data, NULL, NULL, networkinstall_confirm_onresponse);
@@ -362,6 +577,7 @@ void networkinstall_open() {
     data->installInfo.op = DATAOP_COPY;
 
     data->installInfo.copyEmpty = false;
+    data->installInfo.fillSrc = true;
 
     data->installInfo.isSrcDirectory = networkinstall_is_src_directory;
     data->installInfo.makeDstDirectory = networkinstall_make_dst_directory;
@@ -11,6 +11,7 @@
 #include "../info.h"
 #include "../prompt.h"
 #include "../ui.h"
+#include "../../core/http.h"
 #include "../../core/screen.h"
 #include "../../core/util.h"
 #include "../../quirc/quirc_internal.h"
@@ -18,14 +19,39 @@
 #define IMAGE_WIDTH 400
 #define IMAGE_HEIGHT 240
 
-#define URL_MAX 1024
+#define URL_MAX HTTP_URL_MAX
 #define URLS_MAX 128
 
+#define PAYLOAD_QUEUE_SIZE 2
+
+// Frames searched around the last detection before the whole frame is
+// searched again, in case another code has come into view.
+#define ROI_FULL_SCAN_INTERVAL 8
+
 typedef struct {
     struct quirc* qrContext;
     char urls[URLS_MAX][URL_MAX];
 
     u32 tex;
+    u32 texFrame;
+
+    // Detection runs on its own thread against the newest camera frame and
+    // queues decoded payloads for the UI, which only draws the preview. The
+    // frame is copied out first, so the camera is never held up by a scan.
+    Thread decodeThread;
+    u16* scanFrame;
+    volatile bool decodeStop;
+    volatile bool scanning;
+    Handle payloadMutex;
+    struct quirc_data payloads[PAYLOAD_QUEUE_SIZE];
+    u32 payloadHead;
+    u32 payloadCount;
+
+    // Where the last code or capstone was seen, padded; searched first.
+    bool roiValid;
+    struct quirc_point roiMin;
+    struct quirc_point roiMax;
+    u32 roiFrames;
 
     u32 responseCode;
     u64 currTitleId;
@@ -52,32 +78,17 @@ static Result qrinstall_open_src(void* data, u32 index, u32* handle) {
 
     Result res = 0;
 
-    httpcContext* context = (httpcContext*) calloc(1, sizeof(httpcContext));
-    if(context != NULL) {
-        if(R_SUCCEEDED(res = httpcOpenContext(context, HTTPC_METHOD_GET, qrInstallData->urls[index], 1))) {
-            httpcSetSSLOpt(context, SSLCOPT_DisableVerify);
-            if(R_SUCCEEDED(res = httpcBeginRequest(context)) && R_SUCCEEDED(res = httpcGetResponseStatusCode(context, &qrInstallData->responseCode, 0))) {
-                if(qrInstallData->responseCode == 200) {
-                    *handle = (u32) context;
-                } else if(qrInstallData->responseCode == 301 || qrInstallData->responseCode == 302 || qrInstallData->responseCode == 303) {
-                    if(R_SUCCEEDED(res = httpcGetResponseHeader(context, "Location", qrInstallData->urls[index], URL_MAX))) {
-                        httpcCloseContext(context);
-                        free(context);
-
-                        return qrinstall_open_src(data, index, handle);
-                    }
-                } else {
-                    res = R_FBI_HTTP_RESPONSE_CODE;
-                }
-            }
+    http_stream* stream = (http_stream*) calloc(1, sizeof(http_stream));
+    if(stream != NULL) {
+        res = http_stream_open(stream, qrInstallData->urls[index]);
 
-            if(R_FAILED(res)) {
-                httpcCloseContext(context);
-            }
-        }
+        qrInstallData->responseCode = stream->responseCode;
+        strncpy(qrInstallData->urls[index], stream->url, URL_MAX);
 
-        if(R_FAILED(res)) {
-            free(context);
+        if(R_SUCCEEDED(res)) {
+            *handle = (u32) stream;
+        } else {
+            free(stream);
         }
     } else {
         res = R_FBI_OUT_OF_MEMORY;
@@ -87,20 +98,20 @@ static Result qrinstall_open_src(void* data, u32 index, u32* handle) {
 }
 
 static Result qrinstall_close_src(void* data, u32 index, bool succeeded, u32 handle) {
-    return httpcCloseContext((httpcContext*) handle);
-}
+    http_stream* stream = (http_stream*) handle;
 
-static Result qrinstall_get_src_size(void* data, u32 handle, u64* size) {
-    u32 downloadSize = 0;
-    Result res = httpcGetDownloadSizeState((httpcContext*) handle, NULL, &downloadSize);
+    Result res = http_stream_close(stream);
+    free(stream);
 
-    *size = downloadSize;
     return res;
 }
 
+static Result qrinstall_get_src_size(void* data, u32 handle, u64* size) {
+    return http_stream_get_size((http_stream*) handle, size);
+}
+
 static Result qrinstall_read_src(void* data, u32 handle, u32* bytesRead, void* buffer, u64 offset, u32 size) {
-    Result res = httpcDownloadData((httpcContext*) handle, buffer, size, bytesRead);
-    return res != HTTPC_RESULTCODE_DOWNLOADPENDING ? res : 0;
+    return http_stream_read((http_stream*) handle, bytesRead, buffer, size);
 }
 
 static Result qrinstall_open_dst(void* data, u32 index, void* initialReadBlock, u32* handle) {
@@ -258,6 +269,19 @@ static void qrinstall_confirm_onresponse(ui_view* view, void* data, bool respons
 }
 
 static void qrinstall_free_data(qr_install_data* data) {
+    if(data->decodeThread != NULL) {
+        data->decodeStop = true;
+
+        threadJoin(data->decodeThread, U64_MAX);
+        threadFree(data->decodeThread);
+        data->decodeThread = NULL;
+    }
+
+    if(data->payloadMutex != 0) {
+        svcCloseHandle(data->payloadMutex);
+        data->payloadMutex = 0;
+    }
+
     if(!data->installInfo.finished) {
         svcSignalEvent(data->installInfo.cancelEvent);
         while(!data->installInfo.finished) {
@@ -277,6 +301,11 @@ static void qrinstall_free_data(qr_install_data* data) {
         data->captureInfo.buffer = NULL;
     }
 
+    if(data->scanFrame != NULL) {
+        free(data->scanFrame);
+        data->scanFrame = NULL;
+    }
+
     if(data->tex != 0) {
         screen_unload_texture(data->tex);
         data->tex = 0;
@@ -298,6 +327,110 @@ static void qrinstall_wait_draw_top(ui_view* view, void* data, float x1, float y
     }
 }
 
+static void qrinstall_track_roi(qr_install_data* data, bool usedRoi) {
+    struct quirc_point min;
+    struct quirc_point max;
+    if(quirc_find_bounds(data->qrContext, &min, &max)) {
+        int padX = max.x - min.x;
+        int padY = max.y - min.y;
+
+        data->roiMin.x = min.x - padX;
+        data->roiMin.y = min.y - padY;
+        data->roiMax.x = max.x + padX;
+        data->roiMax.y = max.y + padY;
+        data->roiValid = true;
+    } else {
+        // A missed hint falls back to the whole frame next time.
+        data->roiValid = false;
+    }
+
+    if(!usedRoi) {
+        data->roiFrames = 0;
+    }
+}
+
+static void qrinstall_decode_frame(qr_install_data* data) {
+    bool useRoi = data->roiValid && data->roiFrames < ROI_FULL_SCAN_INTERVAL;
+    if(useRoi) {
+        quirc_set_roi(data->qrContext, data->roiMin.x, data->roiMin.y, data->roiMax.x - data->roiMin.x + 1, data->roiMax.y - data->roiMin.y + 1);
+        data->roiFrames++;
+    } else {
+        quirc_set_roi(data->qrContext, 0, 0, 0, 0);
+    }
+
+    svcWaitSynchronization(data->captureInfo.mutex, U64_MAX);
+
+    memcpy(data->scanFrame, data->captureInfo.buffer, IMAGE_WIDTH * IMAGE_HEIGHT * sizeof(u16));
+
+    svcReleaseMutex(data->captureInfo.mutex);
+
+    quirc_load_rgb565(data->qrContext, data->scanFrame, IMAGE_WIDTH);
+
+    quirc_end(data->qrContext);
+
+    qrinstall_track_roi(data, useRoi);
+
+    int qrCount = quirc_count(data->qrContext);
+    for(int i = 0; i < qrCount; i++) {
+        struct quirc_code qrCode;
+        quirc_extract(data->qrContext, i, &qrCode);
+
+        // Decoded outside the lock; a failed decode never touches the queue.
+        struct quirc_data qrData;
+        if(quirc_decode(&qrCode, &qrData) != 0) {
+            continue;
+        }
+
+        svcWaitSynchronization(data->payloadMutex, U64_MAX);
+
+        // Payloads are only wanted while the scan view is up; a full queue
+        // drops the oldest.
+        if(data->scanning) {
+            u32 slot = (data->payloadHead + data->payloadCount) % PAYLOAD_QUEUE_SIZE;
+            data->payloads[slot] = qrData;
+
+            if(data->payloadCount < PAYLOAD_QUEUE_SIZE) {
+                data->payloadCount++;
+            } else {
+                data->payloadHead = (data->payloadHead + 1) % PAYLOAD_QUEUE_SIZE;
+            }
+        }
+
+        svcReleaseMutex(data->payloadMutex);
+    }
+}
+
+static void qrinstall_decode_thread(void* arg) {
+    qr_install_data* data = (qr_install_data*) arg;
+
+    u32 lastFrame = 0;
+    while(!data->decodeStop && !data->captureInfo.finished) {
+        // Frames that arrived while the last was being searched are skipped.
+        u32 frame = data->captureInfo.frame;
+        if(!data->scanning || frame == lastFrame) {
+            svcSleepThread(10000000);
+            continue;
+        }
+
+        lastFrame = frame;
+        qrinstall_decode_frame(data);
+    }
+}
+
+// Detection gets a core of its own on the New 3DS. Elsewhere it runs on the
+// application core below the UI's priority, so the preview keeps its rate.
+static Thread qrinstall_start_decode_thread(qr_install_data* data) {
+    u8 n3ds = false;
+    if(R_SUCCEEDED(APT_CheckNew3DS(&n3ds)) && n3ds) {
+        Thread thread = threadCreate(qrinstall_decode_thread, data, 0x10000, 0x18, 2, false);
+        if(thread != NULL) {
+            return thread;
+        }
+    }
+
+    return threadCreate(qrinstall_decode_thread, data, 0x10000, 0x3F, 0, false);
+}
+
 static void qrinstall_wait_update(ui_view* view, void* data, float* progress, char* text) {
     qr_install_data* qrInstallData = (qr_install_data*) data;
 
@@ -323,60 +456,56 @@ static void qrinstall_wait_update(ui_view* view, void* data, float* progress, ch
         return;
     }
 
-    if(qrInstallData->tex != 0) {
-        screen_unload_texture(qrInstallData->tex);
-        qrInstallData->tex = 0;
-    }
-
-    int w = 0;
-    int h = 0;
-    uint8_t* qrBuf = quirc_begin(qrInstallData->qrContext, &w, &h);
+    if(qrInstallData->tex == 0 || qrInstallData->texFrame != qrInstallData->captureInfo.frame) {
+        if(qrInstallData->tex != 0) {
+            screen_unload_texture(qrInstallData->tex);
+            qrInstallData->tex = 0;
+        }
 
-    svcWaitSynchronization(qrInstallData->captureInfo.mutex, U64_MAX);
+        svcWaitSynchronization(qrInstallData->captureInfo.mutex, U64_MAX);
 
-    qrInstallData->tex = screen_load_texture_auto(qrInstallData->captureInfo.buffer, IMAGE_WIDTH * IMAGE_HEIGHT * sizeof(u16), IMAGE_WIDTH, IMAGE_HEIGHT, GPU_RGB565, false);
+        qrInstallData->tex = screen_load_texture_auto(qrInstallData->captureInfo.buffer, IMAGE_WIDTH * IMAGE_HEIGHT * sizeof(u16), IMAGE_WIDTH, IMAGE_HEIGHT, GPU_RGB565, false);
+        qrInstallData->texFrame = qrInstallData->captureInfo.frame;
 
-    for(int x = 0; x < w; x++) {
-        for(int y = 0; y < h; y++) {
-            u16 px = qrInstallData->captureInfo.buffer[y * IMAGE_WIDTH + x];
-            qrBuf[y * w + x] = (u8) (((((px >> 11) & 0x1F) << 3) + (((px >> 5) & 0x3F) << 2) + ((px & 0x1F) << 3)) / 3);
-        }
+        svcReleaseMutex(qrInstallData->captureInfo.mutex);
     }
 
-    svcReleaseMutex(qrInstallData->captureInfo.mutex);
+    svcWaitSynchronization(qrInstallData->payloadMutex, U64_MAX);
 
-    quirc_end(qrInstallData->qrContext);
+    if(qrInstallData->payloadCount > 0) {
+        struct quirc_data* qrData = &qrInstallData->payloads[qrInstallData->payloadHead];
 
-    int qrCount = quirc_count(qrInstallData->qrContext);
-    for(int i = 0; i < qrCount; i++) {
-        struct quirc_code qrCode;
-        quirc_extract(qrInstallData->qrContext, i, &qrCode);
+        qrInstallData->installInfo.total = 0;
 
-        struct quirc_data qrData;
-        quirc_decode_error_t err = quirc_decode(&qrCode, &qrData);
+        char* currStart = (char*) qrData->payload;
+        char* currEnd = NULL;
+        while((currEnd = strchr(currStart, '\n')) != NULL) {
+            u32 len = currEnd - currStart;
+            if(len > URL_MAX) {
+                len = URL_MAX;
+            }
 
-        if(err == 0) {
-            qrInstallData->installInfo.total = 0;
+            strncpy(qrInstallData->urls[qrInstallData->installInfo.total++], currStart, len);
 
-            char* currStart = (char*) qrData.payload;
-            char* currEnd = NULL;
-            while((currEnd = strchr(currStart, '\n')) != NULL) {
-                u32 len = currEnd - currStart;
-                if(len > URL_MAX) {
-                    len = URL_MAX;
-                }
+            currStart = currEnd + 1;
+        }
 
-                strncpy(qrInstallData->urls[qrInstallData->installInfo.total++], currStart, len);
+        if(*currStart != '\0') {
+            strncpy(qrInstallData->urls[qrInstallData->installInfo.total++], currStart, URL_MAX);
+        }
 
-                currStart = currEnd + 1;
-            }
+        // Anything else queued was decoded from the same few frames.
+        qrInstallData->payloadHead = 0;
+        qrInstallData->payloadCount = 0;
+        qrInstallData->scanning = false;
 
-            if(*currStart != '\0') {
-                strncpy(qrInstallData->urls[qrInstallData->installInfo.total++], currStart, URL_MAX);
-            }
+        svcReleaseMutex(qrInstallData->payloadMutex);
 
-            prompt_display("Confirmation", "Install from the scanned URL(s)?", COLOR_TEXT, true, data, NULL, NULL, qrinstall_confirm_onresponse);
-        }
+        prompt_display("Confirmation", "Install from the scanned URL(s)?", COLOR_TEXT, true, data, NULL, NULL, qrinstall_confirm_onresponse);
+    } else {
+        qrInstallData->scanning = true;
+
+        svcReleaseMutex(qrInstallData->payloadMutex);
     }
 
     snprintf(text, PROGRESS_TEXT_MAX, "Waiting for QR code...");
@@ -391,6 +520,7 @@ void qrinstall_open() {
     }
 
     data->tex = 0;
+    data->texFrame = 0;
 
     data->responseCode = 0;
     data->currTitleId = 0;
@@ -441,13 +571,22 @@ void qrinstall_open() {
     }
 
     data->captureInfo.buffer = (u16*) calloc(1, IMAGE_WIDTH * IMAGE_HEIGHT * sizeof(u16));
-    if(data->captureInfo.buffer == NULL) {
+    data->scanFrame = (u16*) calloc(1, IMAGE_WIDTH * IMAGE_HEIGHT * sizeof(u16));
+    if(data->captureInfo.buffer == NULL || data->scanFrame == NULL) {
         error_display(NULL, NULL, NULL, "Failed to create image buffer.");
 
         qrinstall_free_data(data);
         return;
     }
 
+    Result mutexRes = svcCreateMutex(&data->payloadMutex, false);
+    if(R_FAILED(mutexRes)) {
+        error_display_res(NULL, NULL, NULL, mutexRes, "Failed to create QR payload mutex.");
+
+        qrinstall_free_data(data);
+        return;
+    }
+
     Result capRes = task_capture_cam(&data->captureInfo);
     if(R_FAILED(capRes)) {
         error_display_res(NULL, NULL, NULL, capRes, "Failed to start camera capture.");
@@ -456,5 +595,15 @@ void qrinstall_open() {
         return;
     }
 
+    data->scanning = true;
+
+    data->decodeThread = qrinstall_start_decode_thread(data);
+    if(data->decodeThread == NULL) {
+        error_display_res(NULL, NULL, NULL, R_FBI_THREAD_CREATE_FAILED, "Failed to start QR detection.");
+
+        qrinstall_free_data(data);
+        return;
+    }
+
     info_display("QR Code Install", "B: Return", false, data, qrinstall_wait_update, qrinstall_wait_draw_top);
 }
@@ -58,6 +58,7 @@ static void task_capture_cam_thread(void* arg) {
 
                                     svcWaitSynchronization(data->mutex, U64_MAX);
                                     memcpy(data->buffer, buffer, bufferSize);
+                                    data->frame++;
                                     svcReleaseMutex(data->mutex);
 
                                     res = CAMU_SetReceiving(&events[EVENT_RECV], buffer, PORT_CAM1, bufferSize, (s16) transferUnit);
@@ -118,6 +119,7 @@ Result task_capture_cam(capture_cam_data* data) {
     }
 
     data->mutex = 0;
+    data->frame = 0;
 
     data->finished = false;
     data->result = 0;
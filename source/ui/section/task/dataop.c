@@ -1,4 +1,7 @@
 #include <malloc.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <3ds.h>
@@ -6,10 +9,975 @@
 #include "task.h"
 #include "../../list.h"
 #include "../../error.h"
+#include "../../../core/sha256.h"
+#include "../../../core/util.h"
 
-static bool task_data_op_copy(data_op_data* data, u32 index) {
-    data->currProcessed = 0;
-    data->currTotal = 0;
+#define BUFFER_SIZE_MIN (1024 * 64)
+#define BUFFER_SIZE_DEFAULT (1024 * 256)
+#define BUFFER_SIZE_MAX (1024 * 1024)
+#define BUFFER_COUNT 4
+
+#define TUNE_SAMPLE_CHUNKS 4
+#define TUNE_PROFILES_MAX 8
+
+#define WORKERS_MAX 4
+
+#define JOURNAL_MAGIC 0x4A494246 // "FBIJ"
+#define JOURNAL_ID_MAX 0x200
+#define JOURNAL_PATH_MAX 32
+#define JOURNAL_INTERVAL (1024 * 1024 * 4)
+#define JOURNAL_PREFIX_SIZE (1024 * 64)
+
+#define STAGE_OPEN_SRC 0
+#define STAGE_READ_SRC 1
+#define STAGE_OPEN_DST 2
+#define STAGE_WRITE_DST 3
+#define STAGE_CLOSE_DST 4
+#define STAGE_CLOSE_SRC 5
+
+#define STAGE_COUNT 6
+
+#define STATS_BUCKETS 24
+#define STATS_LINE_MAX 512
+
+#define EVENT_FULL 0
+#define EVENT_READ_DONE 1
+#define EVENT_CANCEL 2
+
+#define EVENT_COUNT 3
+
+typedef struct {
+    Result (*readSrc)(void* data, u32 handle, u32* bytesRead, void* buffer, u64 offset, u32 size);
+    Result (*writeDst)(void* data, u32 handle, u32* bytesWritten, void* buffer, u64 offset, u32 size);
+
+    u32 chunkSize;
+    bool tuned;
+} data_op_profile;
+
+// Checkpoint of a partially copied item. crc covers every byte before
+// processed; tailSeed is its value at tailOffset, so a resume only has to
+// re-read the last stretch of the destination to trust the whole prefix.
+// The same stretch and the first bytes of the source (srcCrc) are re-read
+// too, so a source that changed since keeps the copy from resuming; srcCrc
+// itself is taken as those bytes first pass through the copy.
+// sha carries the item's SHA-256 state across the resume when it is hashed.
+typedef struct {
+    u32 magic;
+    u32 index;
+    char id[JOURNAL_ID_MAX];
+    u64 total;
+    u32 srcCrc;
+    u64 processed;
+    u32 crc;
+    u64 tailOffset;
+    u32 tailSeed;
+    u32 hashed;
+    sha256_context sha;
+} data_op_journal;
+
+// Call latencies of one stage; bucket i counts calls that took under 2^i us.
+typedef struct {
+    u32 calls;
+    u64 totalTicks;
+    u64 maxTicks;
+    u32 buckets[STATS_BUCKETS];
+} data_op_stage_stats;
+
+typedef struct {
+    Handle mutex;
+
+    FS_Archive archive;
+    Handle logHandle;
+    u64 logOffset;
+
+    data_op_stage_stats stages[STAGE_COUNT];
+} data_op_stats;
+
+typedef struct data_op_state_s data_op_state;
+
+typedef struct {
+    data_op_state* state;
+
+    u32 index;
+    bool active;
+
+    u64 currProcessed;
+    u64 currTotal;
+
+    Result result;
+} data_op_item;
+
+typedef struct {
+    data_op_item item;
+
+    u32 index;
+    volatile bool busy;
+
+    Thread thread;
+    Handle startEvent;
+} data_op_worker;
+
+struct data_op_state_s {
+    data_op_data* data;
+
+    Handle progressMutex;
+    Handle errorMutex;
+
+    volatile bool stop;
+    volatile bool quit;
+
+    data_op_stats* stats;
+
+    data_op_item inlineItem;
+
+    u32 workerCount;
+    data_op_worker workers[WORKERS_MAX];
+    Handle idleSemaphore;
+};
+
+typedef struct {
+    data_op_data* data;
+    data_op_item* item;
+    data_op_profile profile;
+
+    u32 srcHandle;
+    u32 dstHandle;
+
+    // Resume
+    bool journaled;
+    FS_Archive journalArchive;
+    char journalPath[JOURNAL_PATH_MAX];
+    data_op_journal journal;
+
+    u64 startOffset;
+
+    // Digests of the written bytes, for the journal and hashDst
+    bool hashing;
+    bool hashValid;
+    u32 crc;
+    sha256_context sha;
+    u64 digestOffset;
+
+    // Chunk size tuning
+    u32 chunkSize;
+    u32 startSize;
+    u32 bestSize;
+    u64 bestRate;
+    s32 direction;
+
+    u64 sampleStart;
+    u64 sampleBytes;
+    u32 sampleChunks;
+
+    u32 bufferSize;
+    u8* buffers[BUFFER_COUNT];
+    u32 bufferSizes[BUFFER_COUNT];
+
+    Handle emptySemaphore;
+    Handle fullSemaphore;
+    Handle hashSemaphore;
+    Handle readDoneEvent;
+
+    volatile bool abort;
+    Result readResult;
+} data_op_pipeline;
+
+// Shared by every worker of every running op; guarded by profileMutex.
+static Handle profileMutex = 0;
+static data_op_profile profiles[TUNE_PROFILES_MAX];
+static u32 nextProfile = 0;
+
+static const char* stageNames[STAGE_COUNT] = {"openSrc", "readSrc", "openDst", "writeDst", "closeDst", "closeSrc"};
+
+static u64 task_data_op_ticks_to_us(u64 ticks) {
+    return ticks * 1000000 / SYSCLOCK_ARM11;
+}
+
+__attribute__((format(printf,2,3)))
+static void task_data_op_stats_print(data_op_stats* stats, const char* format, ...) {
+    char line[STATS_LINE_MAX];
+
+    va_list list;
+    va_start(list, format);
+    int len = vsnprintf(line, STATS_LINE_MAX, format, list);
+    va_end(list);
+
+    if(len <= 0) {
+        return;
+    }
+
+    if(len >= STATS_LINE_MAX) {
+        len = STATS_LINE_MAX - 1;
+    }
+
+    u32 bytesWritten = 0;
+    if(R_SUCCEEDED(FSFILE_Write(stats->logHandle, &bytesWritten, stats->logOffset, line, (u32) len, 0))) {
+        stats->logOffset += bytesWritten;
+    }
+}
+
+// Stats are kept when the op asks for them or when /fbi/logs/ exists on the
+// SD card, and are written there as CSV: one row per item as it finishes,
+// then a latency histogram per stage once the op is done.
+static void task_data_op_stats_open(data_op_state* state) {
+    data_op_stats* stats = (data_op_stats*) calloc(1, sizeof(data_op_stats));
+    if(stats == NULL) {
+        return;
+    }
+
+    if(R_SUCCEEDED(FSUSER_OpenArchive(&stats->archive, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, "")))) {
+        if((state->data->logStats || util_is_dir(stats->archive, "/fbi/logs/"))
+           && R_SUCCEEDED(util_ensure_dir(stats->archive, "/fbi/")) && R_SUCCEEDED(util_ensure_dir(stats->archive, "/fbi/logs/"))) {
+            char path[64];
+            snprintf(path, sizeof(path), "/fbi/logs/dataop_%llu.csv", (unsigned long long) osGetTime());
+
+            FS_Path* fsPath = util_make_path_utf8(path);
+            if(fsPath != NULL) {
+                if(R_SUCCEEDED(FSUSER_OpenFile(&stats->logHandle, stats->archive, *fsPath, FS_OPEN_WRITE | FS_OPEN_CREATE, 0))) {
+                    if(R_SUCCEEDED(svcCreateMutex(&stats->mutex, false))) {
+                        task_data_op_stats_print(stats, "item,bytes,us,bytes_per_sec,result\n");
+
+                        state->stats = stats;
+                    } else {
+                        FSFILE_Close(stats->logHandle);
+                    }
+                }
+
+                util_free_path_utf8(fsPath);
+            }
+        }
+
+        if(state->stats == NULL) {
+            FSUSER_CloseArchive(stats->archive);
+        }
+    }
+
+    if(state->stats == NULL) {
+        free(stats);
+    }
+}
+
+static void task_data_op_stats_close(data_op_state* state) {
+    data_op_stats* stats = state->stats;
+    if(stats == NULL) {
+        return;
+    }
+
+    task_data_op_stats_print(stats, "\nstage,calls,total_us,max_us");
+    for(u32 i = 0; i < STATS_BUCKETS; i++) {
+        task_data_op_stats_print(stats, ",lt_%luus", 1UL << i);
+    }
+
+    task_data_op_stats_print(stats, "\n");
+
+    for(u32 stage = 0; stage < STAGE_COUNT; stage++) {
+        data_op_stage_stats* stageStats = &stats->stages[stage];
+
+        task_data_op_stats_print(stats, "%s,%lu,%llu,%llu", stageNames[stage], (unsigned long) stageStats->calls,
+                                 (unsigned long long) task_data_op_ticks_to_us(stageStats->totalTicks), (unsigned long long) task_data_op_ticks_to_us(stageStats->maxTicks));
+        for(u32 i = 0; i < STATS_BUCKETS; i++) {
+            task_data_op_stats_print(stats, ",%lu", (unsigned long) stageStats->buckets[i]);
+        }
+
+        task_data_op_stats_print(stats, "\n");
+    }
+
+    FSFILE_Close(stats->logHandle);
+    FSUSER_CloseArchive(stats->archive);
+    svcCloseHandle(stats->mutex);
+    free(stats);
+
+    state->stats = NULL;
+}
+
+static void task_data_op_stats_stage(data_op_state* state, u32 stage, u64 start) {
+    data_op_stats* stats = state->stats;
+    if(stats == NULL) {
+        return;
+    }
+
+    u64 ticks = svcGetSystemTick() - start;
+    u64 us = task_data_op_ticks_to_us(ticks);
+
+    u32 bucket = 0;
+    while(bucket < STATS_BUCKETS - 1 && us >= (1ULL << bucket)) {
+        bucket++;
+    }
+
+    svcWaitSynchronization(stats->mutex, U64_MAX);
+
+    data_op_stage_stats* stageStats = &stats->stages[stage];
+    stageStats->calls++;
+    stageStats->totalTicks += ticks;
+    if(ticks > stageStats->maxTicks) {
+        stageStats->maxTicks = ticks;
+    }
+
+    stageStats->buckets[bucket]++;
+
+    svcReleaseMutex(stats->mutex);
+}
+
+static void task_data_op_stats_item(data_op_item* item, u32 index, u64 start) {
+    data_op_stats* stats = item->state->stats;
+    if(stats == NULL) {
+        return;
+    }
+
+    u64 ticks = svcGetSystemTick() - start;
+    u64 rate = item->currProcessed * SYSCLOCK_ARM11 / (ticks + 1);
+
+    svcWaitSynchronization(stats->mutex, U64_MAX);
+    task_data_op_stats_print(stats, "%lu,%llu,%llu,%llu,%08lX\n", (unsigned long) index, (unsigned long long) item->currProcessed,
+                             (unsigned long long) task_data_op_ticks_to_us(ticks), (unsigned long long) rate, (unsigned long) item->result);
+    svcReleaseMutex(stats->mutex);
+}
+
+// Items only contribute to the op-wide progress while in flight; a finished
+// item's bytes are taken back out, so the totals cover the running items only.
+static void task_data_op_set_progress(data_op_item* item, u64 processed, u64 total) {
+    data_op_state* state = item->state;
+
+    svcWaitSynchronization(state->progressMutex, U64_MAX);
+
+    state->data->currProcessed += processed - item->currProcessed;
+    state->data->currTotal += total - item->currTotal;
+
+    svcReleaseMutex(state->progressMutex);
+
+    item->currProcessed = processed;
+    item->currTotal = total;
+}
+
+static bool task_data_op_error(data_op_item* item, u32 index, Result res) {
+    data_op_state* state = item->state;
+
+    bool cont = false;
+
+    svcWaitSynchronization(state->errorMutex, U64_MAX);
+
+    if(!state->stop && !(cont = state->data->error(state->data->data, index, res))) {
+        state->stop = true;
+    }
+
+    svcReleaseMutex(state->errorMutex);
+
+    return cont;
+}
+
+// Must be called with profileMutex held.
+static data_op_profile* task_data_op_find_profile(data_op_data* data) {
+    for(u32 i = 0; i < TUNE_PROFILES_MAX; i++) {
+        if(profiles[i].readSrc == data->readSrc && profiles[i].writeDst == data->writeDst) {
+            return &profiles[i];
+        }
+    }
+
+    data_op_profile* profile = &profiles[nextProfile];
+    nextProfile = (nextProfile + 1) % TUNE_PROFILES_MAX;
+
+    profile->readSrc = data->readSrc;
+    profile->writeDst = data->writeDst;
+    profile->chunkSize = BUFFER_SIZE_DEFAULT;
+    profile->tuned = false;
+
+    return profile;
+}
+
+// Pipelines work on a copy, as the slot may be handed to another callback
+// pair while they run.
+static void task_data_op_get_profile(data_op_data* data, data_op_profile* profile) {
+    svcWaitSynchronization(profileMutex, U64_MAX);
+    *profile = *task_data_op_find_profile(data);
+    svcReleaseMutex(profileMutex);
+}
+
+static void task_data_op_set_profile(data_op_data* data, u32 chunkSize) {
+    svcWaitSynchronization(profileMutex, U64_MAX);
+
+    data_op_profile* profile = task_data_op_find_profile(data);
+    profile->chunkSize = chunkSize;
+    profile->tuned = true;
+
+    svcReleaseMutex(profileMutex);
+}
+
+// Hill-climbs the chunk size on measured pipeline throughput, first growing
+// and then, if growing never helped, shrinking. The winner is remembered per
+// source/destination callback pair so later copies start from it untuned.
+static void task_data_op_copy_tune(data_op_pipeline* pipeline, u32 bytesRead) {
+    if(pipeline->direction == 0) {
+        return;
+    }
+
+    u64 now = svcGetSystemTick();
+
+    // Skip the first chunk at each size; it still carries setup cost and
+    // chunks of the previous size queued ahead of it.
+    if(pipeline->sampleStart == 0) {
+        pipeline->sampleStart = now;
+        return;
+    }
+
+    pipeline->sampleBytes += bytesRead;
+    if(++pipeline->sampleChunks < TUNE_SAMPLE_CHUNKS) {
+        return;
+    }
+
+    u64 rate = pipeline->sampleBytes * SYSCLOCK_ARM11 / (now - pipeline->sampleStart + 1);
+
+    u32 nextSize = 0;
+    if(rate > pipeline->bestRate + pipeline->bestRate / 20) {
+        pipeline->bestRate = rate;
+        pipeline->bestSize = pipeline->chunkSize;
+
+        nextSize = pipeline->direction > 0 ? pipeline->chunkSize * 2 : pipeline->chunkSize / 2;
+    } else if(pipeline->direction > 0 && pipeline->bestSize == pipeline->startSize) {
+        pipeline->direction = -1;
+
+        nextSize = pipeline->bestSize / 2;
+    }
+
+    if(nextSize < BUFFER_SIZE_MIN || nextSize > pipeline->bufferSize) {
+        pipeline->chunkSize = pipeline->bestSize;
+        pipeline->direction = 0;
+
+        task_data_op_set_profile(pipeline->data, pipeline->bestSize);
+    } else {
+        pipeline->chunkSize = nextSize;
+
+        pipeline->sampleStart = 0;
+        pipeline->sampleBytes = 0;
+        pipeline->sampleChunks = 0;
+    }
+}
+
+static Result task_data_op_journal_open(data_op_pipeline* pipeline, Handle* handle, u32 flags) {
+    Result res = 0;
+
+    FS_Path* fsPath = util_make_path_utf8(pipeline->journalPath);
+    if(fsPath != NULL) {
+        res = FSUSER_OpenFile(handle, pipeline->journalArchive, *fsPath, flags, 0);
+
+        util_free_path_utf8(fsPath);
+    } else {
+        res = R_FBI_OUT_OF_MEMORY;
+    }
+
+    return res;
+}
+
+// Checkpoints are best-effort; a copy never fails because one could not be saved.
+static void task_data_op_journal_save(data_op_pipeline* pipeline) {
+    Handle fileHandle = 0;
+    if(R_SUCCEEDED(task_data_op_journal_open(pipeline, &fileHandle, FS_OPEN_WRITE | FS_OPEN_CREATE))) {
+        u32 bytesWritten = 0;
+        FSFILE_Write(fileHandle, &bytesWritten, 0, &pipeline->journal, sizeof(data_op_journal), FS_WRITE_FLUSH);
+        FSFILE_Close(fileHandle);
+    }
+}
+
+static void task_data_op_journal_delete(data_op_pipeline* pipeline) {
+    FS_Path* fsPath = util_make_path_utf8(pipeline->journalPath);
+    if(fsPath != NULL) {
+        FSUSER_DeleteFile(pipeline->journalArchive, *fsPath);
+
+        util_free_path_utf8(fsPath);
+    }
+}
+
+static Result task_data_op_journal_key(data_op_data* data, u32 index, char* id, u32* key) {
+    Result res = data->getJournalId(data->data, index, id, JOURNAL_ID_MAX);
+    if(R_SUCCEEDED(res)) {
+        *key = util_crc32(0, id, strlen(id));
+    }
+
+    return res;
+}
+
+// Continues crc over [offset, end) of an item's source or destination.
+static Result task_data_op_copy_crc(data_op_pipeline* pipeline, Result (*read)(void* data, u32 handle, u32* bytesRead, void* buffer, u64 offset, u32 size),
+                                    u32 handle, u64 offset, u64 end, u32* crc) {
+    Result res = 0;
+
+    while(offset < end) {
+        u32 currSize = BUFFER_COUNT * pipeline->bufferSize;
+        if((u64) currSize > end - offset) {
+            currSize = (u32) (end - offset);
+        }
+
+        u32 bytesRead = 0;
+        if(R_FAILED(res = read(pipeline->data->data, handle, &bytesRead, pipeline->buffers[0], offset, currSize))) {
+            break;
+        }
+
+        if(bytesRead == 0) {
+            res = R_FBI_OUT_OF_RANGE;
+            break;
+        }
+
+        *crc = util_crc32(*crc, pipeline->buffers[0], bytesRead);
+        offset += bytesRead;
+    }
+
+    return res;
+}
+
+static bool task_data_op_copy_verify_tail(data_op_pipeline* pipeline, u32 srcCrc) {
+    data_op_data* data = pipeline->data;
+    data_op_journal* journal = &pipeline->journal;
+
+    u32 dstTailCrc = journal->tailSeed;
+    u32 srcTailCrc = journal->tailSeed;
+
+    return srcCrc == journal->srcCrc
+           && R_SUCCEEDED(task_data_op_copy_crc(pipeline, data->readDst, pipeline->dstHandle, journal->tailOffset, journal->processed, &dstTailCrc))
+           && dstTailCrc == journal->crc
+           && R_SUCCEEDED(task_data_op_copy_crc(pipeline, data->readSrc, pipeline->srcHandle, journal->tailOffset, journal->processed, &srcTailCrc))
+           && srcTailCrc == journal->crc;
+}
+
+// Picks up a journaled copy of the same item where it left off, or starts a
+// fresh journal for it.
+static void task_data_op_copy_resume(data_op_pipeline* pipeline, u32 index) {
+    data_op_data* data = pipeline->data;
+    data_op_item* item = pipeline->item;
+    data_op_journal* journal = &pipeline->journal;
+
+    // Nothing smaller than a checkpoint interval is ever checkpointed.
+    if(item->currTotal <= JOURNAL_INTERVAL) {
+        return;
+    }
+
+    char id[JOURNAL_ID_MAX];
+    memset(id, 0, sizeof(id));
+
+    u32 key = 0;
+    if(R_FAILED(task_data_op_journal_key(data, index, id, &key))
+       || R_FAILED(FSUSER_OpenArchive(&pipeline->journalArchive, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, "")))) {
+        return;
+    }
+
+    if(R_FAILED(util_ensure_dir(pipeline->journalArchive, "/fbi/")) || R_FAILED(util_ensure_dir(pipeline->journalArchive, "/fbi/journal/"))) {
+        FSUSER_CloseArchive(pipeline->journalArchive);
+        return;
+    }
+
+    snprintf(pipeline->journalPath, JOURNAL_PATH_MAX, "/fbi/journal/%08lX.dat", (unsigned long) key);
+    pipeline->journaled = true;
+
+    u32 bytesRead = 0;
+
+    Handle fileHandle = 0;
+    if(data->resume && R_SUCCEEDED(task_data_op_journal_open(pipeline, &fileHandle, FS_OPEN_READ))) {
+        FSFILE_Read(fileHandle, &bytesRead, 0, journal, sizeof(data_op_journal));
+        FSFILE_Close(fileHandle);
+    }
+
+    if(bytesRead == sizeof(data_op_journal) && journal->magic == JOURNAL_MAGIC && journal->index == index
+       && strncmp(journal->id, id, JOURNAL_ID_MAX) == 0 && journal->total == item->currTotal
+       && journal->processed > 0 && journal->processed < journal->total
+       && R_SUCCEEDED(data->reopenDst(data->data, index, &pipeline->dstHandle))) {
+        // The identity of the source the journal is bound to.
+        u32 srcCrc = 0;
+        if(R_SUCCEEDED(task_data_op_copy_crc(pipeline, data->readSrc, pipeline->srcHandle, 0, JOURNAL_PREFIX_SIZE, &srcCrc))
+           && task_data_op_copy_verify_tail(pipeline, srcCrc)) {
+            pipeline->startOffset = journal->processed;
+
+            pipeline->digestOffset = journal->processed;
+            pipeline->crc = journal->crc;
+            pipeline->hashValid = pipeline->hashing && journal->hashed;
+            pipeline->sha = journal->sha;
+
+            journal->tailOffset = journal->processed;
+            journal->tailSeed = journal->crc;
+
+            task_data_op_set_progress(item, journal->processed, item->currTotal);
+            return;
+        }
+
+        data->closeDst(data->data, index, false, pipeline->dstHandle);
+        pipeline->dstHandle = 0;
+    }
+
+    // A checkpoint that will not be resumed must not outlive this attempt.
+    task_data_op_journal_delete(pipeline);
+
+    memset(journal, 0, sizeof(data_op_journal));
+    journal->magic = JOURNAL_MAGIC;
+    journal->index = index;
+    strncpy(journal->id, id, JOURNAL_ID_MAX);
+    journal->total = item->currTotal;
+}
+
+static void task_data_op_copy_checkpoint(data_op_pipeline* pipeline) {
+    data_op_journal* journal = &pipeline->journal;
+
+    u64 processed = pipeline->digestOffset;
+    if(processed - journal->tailOffset >= JOURNAL_INTERVAL && processed < journal->total) {
+        journal->processed = processed;
+        journal->crc = pipeline->crc;
+        journal->hashed = pipeline->hashValid;
+        journal->sha = pipeline->sha;
+
+        task_data_op_journal_save(pipeline);
+
+        journal->tailOffset = processed;
+        journal->tailSeed = pipeline->crc;
+    }
+}
+
+// Runs over each slot once it has been written, in order.
+static void task_data_op_copy_digest(data_op_pipeline* pipeline, u8* buffer, u32 size) {
+    if(pipeline->hashValid) {
+        sha256_update(&pipeline->sha, buffer, size);
+    }
+
+    if(pipeline->journaled && pipeline->digestOffset < JOURNAL_PREFIX_SIZE && pipeline->digestOffset + size >= JOURNAL_PREFIX_SIZE) {
+        pipeline->journal.srcCrc = util_crc32(pipeline->crc, buffer, (u32) (JOURNAL_PREFIX_SIZE - pipeline->digestOffset));
+    }
+
+    pipeline->crc = util_crc32(pipeline->crc, buffer, size);
+    pipeline->digestOffset += size;
+
+    if(pipeline->journaled) {
+        task_data_op_copy_checkpoint(pipeline);
+    }
+}
+
+static void task_data_op_copy_hash_thread(void* arg) {
+    data_op_pipeline* pipeline = (data_op_pipeline*) arg;
+
+    u32 slot = 0;
+    while(pipeline->digestOffset < pipeline->item->currTotal) {
+        if(R_FAILED(svcWaitSynchronization(pipeline->hashSemaphore, U64_MAX)) || pipeline->abort) {
+            break;
+        }
+
+        task_data_op_copy_digest(pipeline, pipeline->buffers[slot], pipeline->bufferSizes[slot]);
+        slot = (slot + 1) % BUFFER_COUNT;
+
+        s32 count = 0;
+        svcReleaseSemaphore(&count, pipeline->emptySemaphore, 1);
+    }
+}
+
+// Hashing gets a core of its own on the New 3DS. Elsewhere it shares the
+// application core, leaving the copy threads alone on the system core. It
+// runs at the writer's priority either way: slots are only reused once
+// hashed, so a hash thread queued behind the UI would stall the copy.
+static Thread task_data_op_copy_start_hash_thread(data_op_pipeline* pipeline) {
+    u8 n3ds = false;
+    if(R_SUCCEEDED(APT_CheckNew3DS(&n3ds)) && n3ds) {
+        Thread thread = threadCreate(task_data_op_copy_hash_thread, pipeline, 0x10000, 0x18, 2, false);
+        if(thread != NULL) {
+            return thread;
+        }
+    }
+
+    return threadCreate(task_data_op_copy_hash_thread, pipeline, 0x10000, 0x18, 0, false);
+}
+
+static void task_data_op_copy_read_thread(void* arg) {
+    data_op_pipeline* pipeline = (data_op_pipeline*) arg;
+    data_op_data* data = pipeline->data;
+    data_op_item* item = pipeline->item;
+
+    Result res = 0;
+
+    u64 offset = pipeline->startOffset;
+    u32 slot = 0;
+    while(offset < item->currTotal) {
+        if(R_FAILED(res = svcWaitSynchronization(pipeline->emptySemaphore, U64_MAX)) || pipeline->abort) {
+            break;
+        }
+
+        u32 currSize = pipeline->chunkSize;
+        if((u64) currSize > item->currTotal - offset) {
+            currSize = (u32) (item->currTotal - offset);
+        }
+
+        // Streaming sources fill the whole chunk in place over several short reads.
+        u32 wanted = data->fillSrc ? currSize : 1;
+
+        u32 bytesRead = 0;
+        while(bytesRead < wanted) {
+            svcWaitSynchronization(task_get_pause_event(), U64_MAX);
+            if(task_is_quit_all() || svcWaitSynchronization(data->cancelEvent, 0) == 0) {
+                res = R_FBI_CANCELLED;
+                break;
+            }
+
+            if(pipeline->abort) {
+                break;
+            }
+
+            u32 currRead = 0;
+
+            u64 start = svcGetSystemTick();
+            res = data->readSrc(data->data, pipeline->srcHandle, &currRead, pipeline->buffers[slot] + bytesRead, offset + bytesRead, currSize - bytesRead);
+            task_data_op_stats_stage(item->state, STAGE_READ_SRC, start);
+
+            if(R_FAILED(res)) {
+                break;
+            }
+
+            bytesRead += currRead;
+
+            // Let the writer run while a streaming source has nothing ready
+            // yet; any other source that returns nothing has ended.
+            if(currRead == 0) {
+                if(!data->fillSrc) {
+                    break;
+                }
+
+                svcSleepThread(1000000);
+            }
+        }
+
+        if(bytesRead == 0 || R_FAILED(res) || pipeline->abort) {
+            break;
+        }
+
+        pipeline->bufferSizes[slot] = bytesRead;
+        offset += bytesRead;
+        slot = (slot + 1) % BUFFER_COUNT;
+
+        s32 count = 0;
+        svcReleaseSemaphore(&count, pipeline->fullSemaphore, 1);
+
+        task_data_op_copy_tune(pipeline, bytesRead);
+    }
+
+    pipeline->readResult = res;
+    svcSignalEvent(pipeline->readDoneEvent);
+}
+
+static Result task_data_op_copy_pipeline(data_op_item* item, u32 index, u32 srcHandle) {
+    data_op_data* data = item->state->data;
+
+    Result res = 0;
+
+    data_op_pipeline pipeline;
+    memset(&pipeline, 0, sizeof(pipeline));
+
+    pipeline.data = data;
+    pipeline.item = item;
+    pipeline.srcHandle = srcHandle;
+
+    task_data_op_get_profile(data, &pipeline.profile);
+
+    // Keep the rings of all workers together within a quarter of the free heap.
+    u32 workerCount = item->state->workerCount > 1 ? item->state->workerCount : 1;
+    u32 budget = task_get_free_buffer_memory() / (BUFFER_COUNT * 4 * workerCount);
+    if(budget > BUFFER_SIZE_MAX) {
+        budget = BUFFER_SIZE_MAX;
+    }
+
+    budget &= ~(BUFFER_SIZE_MIN - 1);
+    if(budget < BUFFER_SIZE_MIN) {
+        budget = BUFFER_SIZE_MIN;
+    }
+
+    pipeline.bufferSize = pipeline.profile.tuned && pipeline.profile.chunkSize < budget ? pipeline.profile.chunkSize : budget;
+    pipeline.chunkSize = pipeline.profile.chunkSize < pipeline.bufferSize ? pipeline.profile.chunkSize : pipeline.bufferSize;
+
+    if(item->currTotal < pipeline.bufferSize) {
+        pipeline.bufferSize = (u32) item->currTotal;
+        pipeline.chunkSize = pipeline.bufferSize;
+    } else if(!pipeline.profile.tuned) {
+        pipeline.startSize = pipeline.chunkSize;
+        pipeline.bestSize = pipeline.chunkSize;
+        pipeline.direction = 1;
+    }
+
+    u8* buffer = (u8*) task_alloc_buffer(BUFFER_COUNT * pipeline.bufferSize);
+    if(buffer == NULL) {
+        return R_FBI_OUT_OF_MEMORY;
+    }
+
+    for(u32 i = 0; i < BUFFER_COUNT; i++) {
+        pipeline.buffers[i] = buffer + i * pipeline.bufferSize;
+    }
+
+    pipeline.hashing = data->hashDst != NULL;
+    pipeline.hashValid = pipeline.hashing;
+    sha256_init(&pipeline.sha);
+
+    if(data->getJournalId != NULL && data->reopenDst != NULL && data->readDst != NULL) {
+        task_data_op_copy_resume(&pipeline, index);
+    }
+
+    if(R_SUCCEEDED(res = svcCreateSemaphore(&pipeline.emptySemaphore, BUFFER_COUNT, BUFFER_COUNT))
+       && R_SUCCEEDED(res = svcCreateSemaphore(&pipeline.fullSemaphore, 0, BUFFER_COUNT))
+       && R_SUCCEEDED(res = svcCreateSemaphore(&pipeline.hashSemaphore, 0, BUFFER_COUNT))
+       && R_SUCCEEDED(res = svcCreateEvent(&pipeline.readDoneEvent, 1))) {
+        // Without a hash thread, any digesting happens inline on the writer.
+        Thread hashThread = pipeline.hashing ? task_data_op_copy_start_hash_thread(&pipeline) : NULL;
+
+        Thread readThread = threadCreate(task_data_op_copy_read_thread, &pipeline, 0x10000, 0x18, 1, false);
+        if(readThread != NULL) {
+            Handle events[EVENT_COUNT] = {pipeline.fullSemaphore, pipeline.readDoneEvent, data->cancelEvent};
+
+            u32 slot = 0;
+            while(item->currProcessed < item->currTotal) {
+                svcWaitSynchronization(task_get_pause_event(), U64_MAX);
+                if(task_is_quit_all() || svcWaitSynchronization(data->cancelEvent, 0) == 0) {
+                    res = R_FBI_CANCELLED;
+                    break;
+                }
+
+                s32 event = 0;
+                if(R_FAILED(res = svcWaitSynchronizationN(&event, events, EVENT_COUNT, false, U64_MAX))) {
+                    break;
+                }
+
+                if(event == EVENT_CANCEL) {
+                    continue;
+                }
+
+                // The reader may have queued its last blocks before stopping.
+                // A reader that stopped cleanly with nothing left to write
+                // ran into the end of a source shorter than its size.
+                if(event == EVENT_READ_DONE && svcWaitSynchronization(pipeline.fullSemaphore, 0) != 0) {
+                    res = R_SUCCEEDED(pipeline.readResult) ? R_FBI_UNEXPECTED_EOF : pipeline.readResult;
+                    break;
+                }
+
+                u8* currBuffer = pipeline.buffers[slot];
+                u32 currSize = pipeline.bufferSizes[slot];
+
+                if(pipeline.dstHandle == 0) {
+                    u64 start = svcGetSystemTick();
+                    res = data->openDst(data->data, index, currBuffer, &pipeline.dstHandle);
+                    task_data_op_stats_stage(item->state, STAGE_OPEN_DST, start);
+
+                    if(R_FAILED(res)) {
+                        break;
+                    }
+                }
+
+                u32 written = 0;
+                while(written < currSize) {
+                    if(task_is_quit_all() || svcWaitSynchronization(data->cancelEvent, 0) == 0) {
+                        res = R_FBI_CANCELLED;
+                        break;
+                    }
+
+                    u32 bytesWritten = 0;
+
+                    u64 start = svcGetSystemTick();
+                    res = data->writeDst(data->data, pipeline.dstHandle, &bytesWritten, currBuffer + written, item->currProcessed, currSize - written);
+                    task_data_op_stats_stage(item->state, STAGE_WRITE_DST, start);
+
+                    if(R_FAILED(res)) {
+                        break;
+                    }
+
+                    // A destination that accepts nothing would otherwise be retried forever.
+                    if(bytesWritten == 0) {
+                        res = R_FBI_WRITE_STALLED;
+                        break;
+                    }
+
+                    written += bytesWritten;
+                    task_data_op_set_progress(item, item->currProcessed + bytesWritten, item->currTotal);
+                }
+
+                if(R_FAILED(res)) {
+                    break;
+                }
+
+                slot = (slot + 1) % BUFFER_COUNT;
+
+                s32 count = 0;
+                if(hashThread != NULL) {
+                    svcReleaseSemaphore(&count, pipeline.hashSemaphore, 1);
+                } else {
+                    if(pipeline.hashing || pipeline.journaled) {
+                        task_data_op_copy_digest(&pipeline, currBuffer, currSize);
+                    }
+
+                    svcReleaseSemaphore(&count, pipeline.emptySemaphore, 1);
+                }
+            }
+
+            // Let the hash stage catch up on the last slots of a finished copy.
+            if(hashThread != NULL && R_SUCCEEDED(res)) {
+                threadJoin(hashThread, U64_MAX);
+            }
+
+            pipeline.abort = true;
+
+            s32 count = 0;
+            svcReleaseSemaphore(&count, pipeline.emptySemaphore, 1);
+
+            threadJoin(readThread, U64_MAX);
+            threadFree(readThread);
+        } else {
+            res = R_FBI_THREAD_CREATE_FAILED;
+        }
+
+        if(hashThread != NULL) {
+            pipeline.abort = true;
+
+            s32 count = 0;
+            svcReleaseSemaphore(&count, pipeline.hashSemaphore, 1);
+
+            threadJoin(hashThread, U64_MAX);
+            threadFree(hashThread);
+        }
+    }
+
+    if(R_SUCCEEDED(res) && pipeline.hashValid && pipeline.dstHandle != 0) {
+        u8 sha256[SHA256_DIGEST_SIZE];
+        sha256_final(&pipeline.sha, sha256);
+
+        res = data->hashDst(data->data, index, sha256, pipeline.crc);
+    }
+
+    if(pipeline.dstHandle != 0) {
+        u64 start = svcGetSystemTick();
+        Result closeDstRes = data->closeDst(data->data, index, res == 0, pipeline.dstHandle);
+        task_data_op_stats_stage(item->state, STAGE_CLOSE_DST, start);
+
+        if(R_SUCCEEDED(res)) {
+            res = closeDstRes;
+        }
+    }
+
+    // Failed or cancelled copies keep their last checkpoint for the next attempt.
+    if(pipeline.journaled) {
+        if(R_SUCCEEDED(res)) {
+            task_data_op_journal_delete(&pipeline);
+        }
+
+        FSUSER_CloseArchive(pipeline.journalArchive);
+    }
+
+    if(pipeline.readDoneEvent != 0) {
+        svcCloseHandle(pipeline.readDoneEvent);
+    }
+
+    if(pipeline.hashSemaphore != 0) {
+        svcCloseHandle(pipeline.hashSemaphore);
+    }
+
+    if(pipeline.fullSemaphore != 0) {
+        svcCloseHandle(pipeline.fullSemaphore);
+    }
+
+    if(pipeline.emptySemaphore != 0) {
+        svcCloseHandle(pipeline.emptySemaphore);
+    }
+
+    task_free_buffer(buffer);
+
+    return res;
+}
+
+static bool task_data_op_copy(data_op_item* item, u32 index) {
+    data_op_data* data = item->state->data;
 
     Result res = 0;
 
@@ -18,9 +986,17 @@ static bool task_data_op_copy(data_op_data* data, u32 index) {
         res = data->makeDstDirectory(data->data, index);
     } else {
         u32 srcHandle = 0;
-        if(R_SUCCEEDED(res = data->openSrc(data->data, index, &srcHandle))) {
-            if(R_SUCCEEDED(res = data->getSrcSize(data->data, srcHandle, &data->currTotal))) {
-                if(data->currTotal == 0) {
+
+        u64 start = svcGetSystemTick();
+        res = data->openSrc(data->data, index, &srcHandle);
+        task_data_op_stats_stage(item->state, STAGE_OPEN_SRC, start);
+
+        if(R_SUCCEEDED(res)) {
+            u64 size = 0;
+            if(R_SUCCEEDED(res = data->getSrcSize(data->data, srcHandle, &size))) {
+                task_data_op_set_progress(item, 0, size);
+
+                if(size == 0) {
                     if(data->copyEmpty) {
                         u32 dstHandle = 0;
                         if(R_SUCCEEDED(res = data->openDst(data->data, index, NULL, &dstHandle))) {
@@ -28,104 +1004,230 @@ static bool task_data_op_copy(data_op_data* data, u32 index) {
                         }
                     }
                 } else {
-                    u32 bufferSize = 1024 * 256;
-                    u8* buffer = (u8*) calloc(1, bufferSize);
-                    if(buffer != NULL) {
-                        u32 dstHandle = 0;
-
-                        bool firstRun = true;
-                        while(data->currProcessed < data->currTotal) {
-                            svcWaitSynchronization(task_get_pause_event(), U64_MAX);
-                            if(task_is_quit_all() || svcWaitSynchronization(data->cancelEvent, 0) == 0) {
-                                res = R_FBI_CANCELLED;
-                                break;
-                            }
-
-                            u32 currSize = bufferSize;
-                            if((u64) currSize > data->currTotal - data->currProcessed) {
-                                currSize = (u32) (data->currTotal - data->currProcessed);
-                            }
-
-                            u32 bytesRead = 0;
-                            u32 bytesWritten = 0;
-                            if(R_FAILED(res = data->readSrc(data->data, srcHandle, &bytesRead, buffer, data->currProcessed, currSize))) {
-                                break;
-                            }
-
-                            if(bytesRead>0 && firstRun) {
-                                firstRun = false;
-
-                                if(R_FAILED(res = data->openDst(data->data, index, buffer, &dstHandle))) {
-                                    break;
-                                }
-                            }
-
-                            if(bytesRead>0 && R_FAILED(res = data->writeDst(data->data, dstHandle, &bytesWritten, buffer, data->currProcessed, bytesRead))) {
-                                break;
-                            }
-
-                            data->currProcessed += bytesWritten;
-                        }
-
-                        if(dstHandle != 0) {
-                            Result closeDstRes = data->closeDst(data->data, index, res == 0, dstHandle);
-                            if(R_SUCCEEDED(res)) {
-                                res = closeDstRes;
-                            }
-                        }
-
-                        free(buffer);
-                    } else {
-                        res = R_FBI_OUT_OF_MEMORY;
-                    }
+                    res = task_data_op_copy_pipeline(item, index, srcHandle);
                 }
             }
 
+            start = svcGetSystemTick();
             Result closeSrcRes = data->closeSrc(data->data, index, res == 0, srcHandle);
+            task_data_op_stats_stage(item->state, STAGE_CLOSE_SRC, start);
+
             if(R_SUCCEEDED(res)) {
                 res = closeSrcRes;
             }
         }
     }
 
+    item->result = res;
+
     if(R_FAILED(res)) {
+        svcWaitSynchronization(item->state->errorMutex, U64_MAX);
         data->result = res;
-        return data->error(data->data, index, res);
+        svcReleaseMutex(item->state->errorMutex);
+
+        return task_data_op_error(item, index, res);
     }
 
     return true;
 }
 
-static bool task_data_op_delete(data_op_data* data, u32 index) {
-    Result res = 0;
-    if(R_FAILED(res = data->delete(data->data, index))) {
-        return data->error(data->data, index, res);
+static bool task_data_op_delete(data_op_item* item, u32 index) {
+    data_op_data* data = item->state->data;
+
+    Result res = item->result = data->delete(data->data, index);
+    if(R_FAILED(res)) {
+        return task_data_op_error(item, index, res);
     }
 
     return true;
 }
 
-static void task_data_op_thread(void* arg) {
-    data_op_data* data = (data_op_data*) arg;
+// With nothing in flight, every item before the next one has finished.
+static void task_data_op_update_current(data_op_state* state) {
+    u32 current = state->data->total;
 
-    for(data->processed = 0; data->processed < data->total; data->processed++) {
-        bool cont = false;
+    if(state->inlineItem.active) {
+        current = state->inlineItem.index;
+    }
 
-        switch(data->op) {
-            case DATAOP_COPY:
-                cont = task_data_op_copy(data, data->processed);
-                break;
-            case DATAOP_DELETE:
-                cont = task_data_op_delete(data, data->processed);
-                break;
-            default:
-                break;
+    for(u32 i = 0; i < state->workerCount; i++) {
+        data_op_item* item = &state->workers[i].item;
+        if(item->active && item->index < current) {
+            current = item->index;
         }
+    }
+
+    state->data->current = current < state->data->total ? current : state->data->processed;
+}
+
+static void task_data_op_process(data_op_item* item, u32 index) {
+    data_op_state* state = item->state;
+
+    item->result = 0;
+
+    svcWaitSynchronization(state->progressMutex, U64_MAX);
+    item->index = index;
+    item->active = true;
+    task_data_op_update_current(state);
+    svcReleaseMutex(state->progressMutex);
+
+    u64 start = svcGetSystemTick();
+
+    bool cont = false;
+
+    switch(state->data->op) {
+        case DATAOP_COPY:
+            cont = task_data_op_copy(item, index);
+            break;
+        case DATAOP_DELETE:
+            cont = task_data_op_delete(item, index);
+            break;
+        default:
+            break;
+    }
+
+    task_data_op_stats_item(item, index, start);
+    task_data_op_set_progress(item, 0, 0);
+
+    svcWaitSynchronization(state->progressMutex, U64_MAX);
+
+    if(cont) {
+        state->data->processed++;
+    }
+
+    item->active = false;
+    task_data_op_update_current(state);
+
+    svcReleaseMutex(state->progressMutex);
+
+    if(!cont) {
+        state->stop = true;
+    }
+}
+
+static void task_data_op_worker_thread(void* arg) {
+    data_op_worker* worker = (data_op_worker*) arg;
+    data_op_state* state = worker->item.state;
+
+    while(R_SUCCEEDED(svcWaitSynchronization(worker->startEvent, U64_MAX)) && !state->quit) {
+        task_data_op_process(&worker->item, worker->index);
+
+        worker->busy = false;
+
+        s32 count = 0;
+        svcReleaseSemaphore(&count, state->idleSemaphore, 1);
+    }
+}
+
+static void task_data_op_start_workers(data_op_state* state) {
+    u32 workerCount = state->data->concurrency;
+    if(workerCount > WORKERS_MAX) {
+        workerCount = WORKERS_MAX;
+    }
+
+    if(workerCount <= 1 || R_FAILED(svcCreateSemaphore(&state->idleSemaphore, 0, workerCount))) {
+        return;
+    }
+
+    for(u32 i = 0; i < workerCount; i++) {
+        data_op_worker* worker = &state->workers[state->workerCount];
+
+        worker->item.state = state;
+
+        if(R_FAILED(svcCreateEvent(&worker->startEvent, 0))) {
+            break;
+        }
+
+        if((worker->thread = threadCreate(task_data_op_worker_thread, worker, 0x10000, 0x18, 1, false)) == NULL) {
+            svcCloseHandle(worker->startEvent);
+            worker->startEvent = 0;
+            break;
+        }
+
+        state->workerCount++;
+    }
+
+    s32 count = 0;
+    svcReleaseSemaphore(&count, state->idleSemaphore, state->workerCount);
+}
+
+static void task_data_op_wait_workers(data_op_state* state) {
+    for(u32 i = 0; i < state->workerCount; i++) {
+        svcWaitSynchronization(state->idleSemaphore, U64_MAX);
+    }
+
+    s32 count = 0;
+    svcReleaseSemaphore(&count, state->idleSemaphore, state->workerCount);
+}
+
+static void task_data_op_stop_workers(data_op_state* state) {
+    task_data_op_wait_workers(state);
+
+    state->quit = true;
+
+    for(u32 i = 0; i < state->workerCount; i++) {
+        data_op_worker* worker = &state->workers[i];
+
+        svcSignalEvent(worker->startEvent);
+
+        threadJoin(worker->thread, U64_MAX);
+        threadFree(worker->thread);
+
+        svcCloseHandle(worker->startEvent);
+    }
+
+    if(state->idleSemaphore != 0) {
+        svcCloseHandle(state->idleSemaphore);
+    }
+}
+
+static void task_data_op_dispatch(data_op_state* state, u32 index) {
+    svcWaitSynchronization(state->idleSemaphore, U64_MAX);
+
+    for(u32 i = 0; i < state->workerCount; i++) {
+        data_op_worker* worker = &state->workers[i];
+
+        if(!worker->busy) {
+            worker->busy = true;
+            worker->index = index;
 
-        if(!cont) {
+            svcSignalEvent(worker->startEvent);
             break;
         }
     }
+}
+
+// Directories are created or removed by themselves, after every earlier
+// item has finished, so nothing inside them is processed out of order.
+static bool task_data_op_is_barrier(data_op_state* state, u32 index) {
+    data_op_data* data = state->data;
+
+    bool isDir = false;
+    return state->workerCount == 0 || (data->isSrcDirectory != NULL && R_SUCCEEDED(data->isSrcDirectory(data->data, index, &isDir)) && isDir);
+}
+
+static void task_data_op_thread(void* arg) {
+    data_op_state* state = (data_op_state*) arg;
+    data_op_data* data = state->data;
+
+    task_data_op_stats_open(state);
+    task_data_op_start_workers(state);
+
+    for(u32 index = 0; index < data->total && !state->stop; index++) {
+        if(task_data_op_is_barrier(state, index)) {
+            task_data_op_wait_workers(state);
+            task_data_op_process(&state->inlineItem, index);
+        } else {
+            task_data_op_dispatch(state, index);
+        }
+    }
+
+    task_data_op_stop_workers(state);
+    task_data_op_stats_close(state);
+
+    svcCloseHandle(state->errorMutex);
+    svcCloseHandle(state->progressMutex);
+    free(state);
 
     svcCloseHandle(data->cancelEvent);
 
@@ -134,12 +1236,116 @@ static void task_data_op_thread(void* arg) {
     aptSetSleepAllowed(true);
 }
 
+// Whether an item's source is still the one its journal was bound to.
+static bool task_data_op_journal_matches_src(data_op_data* data, u32 index, data_op_journal* journal, u8* buffer) {
+    u32 handle = 0;
+    if(R_FAILED(data->openSrc(data->data, index, &handle))) {
+        return false;
+    }
+
+    bool matches = false;
+
+    u64 size = 0;
+    if(R_SUCCEEDED(data->getSrcSize(data->data, handle, &size)) && size == journal->total && size >= JOURNAL_PREFIX_SIZE) {
+        u32 offset = 0;
+        while(offset < JOURNAL_PREFIX_SIZE) {
+            u32 bytesRead = 0;
+            if(R_FAILED(data->readSrc(data->data, handle, &bytesRead, buffer + offset, offset, JOURNAL_PREFIX_SIZE - offset)) || bytesRead == 0) {
+                break;
+            }
+
+            offset += bytesRead;
+        }
+
+        matches = offset == JOURNAL_PREFIX_SIZE && util_crc32(0, buffer, JOURNAL_PREFIX_SIZE) == journal->srcCrc;
+    }
+
+    data->closeSrc(data->data, index, false, handle);
+
+    return matches;
+}
+
+// Probes each item's journal. Journals whose item or source no longer matches
+// are deleted on the way, as a copy would never resume them.
+bool task_data_op_has_journal(data_op_data* data) {
+    if(data->getJournalId == NULL || data->reopenDst == NULL || data->readDst == NULL) {
+        return false;
+    }
+
+    FS_Archive archive = 0;
+    if(R_FAILED(FSUSER_OpenArchive(&archive, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, "")))) {
+        return false;
+    }
+
+    // Most copies find no journals at all; spare them a probe per item.
+    u32 entryCount = 0;
+
+    Handle dirHandle = 0;
+    if(R_SUCCEEDED(FSUSER_OpenDirectory(&dirHandle, archive, fsMakePath(PATH_ASCII, "/fbi/journal/")))) {
+        FS_DirectoryEntry entry;
+        if(R_FAILED(FSDIR_Read(dirHandle, &entryCount, 1, &entry))) {
+            entryCount = 0;
+        }
+
+        FSDIR_Close(dirHandle);
+    }
+
+    u8* buffer = NULL;
+    if(entryCount == 0 || (buffer = (u8*) malloc(JOURNAL_PREFIX_SIZE)) == NULL) {
+        FSUSER_CloseArchive(archive);
+        return false;
+    }
+
+    bool found = false;
+
+    char id[JOURNAL_ID_MAX];
+    char path[JOURNAL_PATH_MAX];
+    data_op_journal journal;
+    for(u32 index = 0; index < data->total && !found; index++) {
+        memset(id, 0, sizeof(id));
+
+        u32 key = 0;
+        if(R_FAILED(task_data_op_journal_key(data, index, id, &key))) {
+            continue;
+        }
+
+        snprintf(path, JOURNAL_PATH_MAX, "/fbi/journal/%08lX.dat", (unsigned long) key);
+
+        FS_Path* fsPath = util_make_path_utf8(path);
+        if(fsPath == NULL) {
+            continue;
+        }
+
+        Handle fileHandle = 0;
+        if(R_SUCCEEDED(FSUSER_OpenFile(&fileHandle, archive, *fsPath, FS_OPEN_READ, 0))) {
+            u32 bytesRead = 0;
+            FSFILE_Read(fileHandle, &bytesRead, 0, &journal, sizeof(data_op_journal));
+            FSFILE_Close(fileHandle);
+
+            if(bytesRead == sizeof(data_op_journal) && journal.magic == JOURNAL_MAGIC && journal.index == index
+               && strncmp(journal.id, id, JOURNAL_ID_MAX) == 0 && task_data_op_journal_matches_src(data, index, &journal, buffer)) {
+                found = true;
+            } else {
+                FSUSER_DeleteFile(archive, *fsPath);
+            }
+        }
+
+        util_free_path_utf8(fsPath);
+    }
+
+    free(buffer);
+    FSUSER_CloseArchive(archive);
+
+    return found;
+}
+
 Result task_data_op(data_op_data* data) {
     if(data == NULL) {
         return R_FBI_INVALID_ARGUMENT;
     }
 
     data->processed = 0;
+    data->current = 0;
 
     data->currProcessed = 0;
     data->currTotal = 0;
@@ -148,9 +1354,22 @@ Result task_data_op(data_op_data* data) {
     data->result = 0;
     data->cancelEvent = 0;
 
+    data_op_state* state = (data_op_state*) calloc(1, sizeof(data_op_state));
+    if(state == NULL) {
+        data->finished = true;
+
+        return R_FBI_OUT_OF_MEMORY;
+    }
+
+    state->data = data;
+    state->inlineItem.state = state;
+
     Result res = 0;
-    if(R_SUCCEEDED(res = svcCreateEvent(&data->cancelEvent, 1))) {
-        if(threadCreate(task_data_op_thread, data, 0x10000, 0x18, 1, true) == NULL) {
+    if((profileMutex != 0 || R_SUCCEEDED(res = svcCreateMutex(&profileMutex, false)))
+       && R_SUCCEEDED(res = svcCreateEvent(&data->cancelEvent, 1))
+       && R_SUCCEEDED(res = svcCreateMutex(&state->progressMutex, false))
+       && R_SUCCEEDED(res = svcCreateMutex(&state->errorMutex, false))) {
+        if(threadCreate(task_data_op_thread, state, 0x10000, 0x18, 1, true) == NULL) {
             res = R_FBI_THREAD_CREATE_FAILED;
         }
     }
@@ -162,6 +1381,16 @@ Result task_data_op(data_op_data* data) {
             svcCloseHandle(data->cancelEvent);
             data->cancelEvent = 0;
         }
+
+        if(state->errorMutex != 0) {
+            svcCloseHandle(state->errorMutex);
+        }
+
+        if(state->progressMutex != 0) {
+            svcCloseHandle(state->progressMutex);
+        }
+
+        free(state);
     }
 
     aptSetSleepAllowed(false);
@@ -174,7 +174,7 @@ static void task_populate_files_thread(void* arg) {
                     Handle dirHandle = 0;
                     if(R_SUCCEEDED(res = FSUSER_OpenDirectory(&dirHandle, curr->archive, *fsPath))) {
                         u32 entryCount = 0;
-                        FS_DirectoryEntry* entries = (FS_DirectoryEntry*) calloc(MAX_FILES, sizeof(FS_DirectoryEntry));
+                        FS_DirectoryEntry* entries = (FS_DirectoryEntry*) task_alloc_buffer(MAX_FILES * sizeof(FS_DirectoryEntry));
                         if(entries != NULL) {
                             if(R_SUCCEEDED(res = FSDIR_Read(dirHandle, &entryCount, MAX_FILES, entries)) && entryCount > 0) {
                                 qsort(entries, entryCount, sizeof(FS_DirectoryEntry), task_populate_files_compare_directory_entries);
@@ -219,7 +219,7 @@ static void task_populate_files_thread(void* arg) {
                                 }
                             }
 
-                            free(entries);
+                            task_free_buffer(entries);
                         } else {
                             res = R_FBI_OUT_OF_MEMORY;
                         }
@@ -1,14 +1,32 @@
+#include <malloc.h>
+#include <unistd.h>
+
 #include <3ds.h>
 
 #include "task.h"
 #include "../../../core/util.h"
 
+#define BUFFER_POOL_SIZE 8
+#define BUFFER_POOL_IDLE_MAX (1024 * 1024 * 4)
+#define BUFFER_ALIGNMENT 0x40
+
+typedef struct {
+    void* buffer;
+    u32 size;
+    bool inUse;
+} task_buffer;
+
+extern char* fake_heap_end;
+
 static bool task_quit;
 
 static Handle task_pause_event;
 
 static aptHookCookie cookie;
 
+static Handle task_buffer_mutex;
+static task_buffer task_buffers[BUFFER_POOL_SIZE];
+
 static void task_apt_hook(APT_HookType hook, void* param) {
     switch(hook) {
         case APTHOOK_ONRESTORE:
@@ -35,6 +53,11 @@ void task_init() {
 
     svcSignalEvent(task_pause_event);
 
+    if(R_FAILED(res = svcCreateMutex(&task_buffer_mutex, false))) {
+        util_panic("Failed to create task buffer mutex: 0x%08lX", res);
+        return;
+    }
+
     aptHook(&cookie, task_apt_hook, NULL);
 }
 
@@ -47,6 +70,20 @@ void task_exit() {
         svcCloseHandle(task_pause_event);
         task_pause_event = 0;
     }
+
+    for(u32 i = 0; i < BUFFER_POOL_SIZE; i++) {
+        if(task_buffers[i].buffer != NULL) {
+            free(task_buffers[i].buffer);
+            task_buffers[i].buffer = NULL;
+            task_buffers[i].size = 0;
+            task_buffers[i].inUse = false;
+        }
+    }
+
+    if(task_buffer_mutex != 0) {
+        svcCloseHandle(task_buffer_mutex);
+        task_buffer_mutex = 0;
+    }
 }
 
 bool task_is_quit_all() {
@@ -55,4 +92,124 @@ bool task_is_quit_all() {
 
 Handle task_get_pause_event() {
     return task_pause_event;
-}
\ No newline at end of file
+}
+
+static u32 task_get_idle_buffer_size() {
+    u32 size = 0;
+    for(u32 i = 0; i < BUFFER_POOL_SIZE; i++) {
+        if(task_buffers[i].buffer != NULL && !task_buffers[i].inUse) {
+            size += task_buffers[i].size;
+        }
+    }
+
+    return size;
+}
+
+static void task_release_idle_buffers() {
+    for(u32 i = 0; i < BUFFER_POOL_SIZE; i++) {
+        if(task_buffers[i].buffer != NULL && !task_buffers[i].inUse) {
+            free(task_buffers[i].buffer);
+            task_buffers[i].buffer = NULL;
+            task_buffers[i].size = 0;
+        }
+    }
+}
+
+u32 task_get_free_buffer_memory() {
+    svcWaitSynchronization(task_buffer_mutex, U64_MAX);
+
+    struct mallinfo info = mallinfo();
+    u32 freeMemory = (u32) info.fordblks + (u32) (fake_heap_end - (char*) sbrk(0)) + task_get_idle_buffer_size();
+
+    svcReleaseMutex(task_buffer_mutex);
+
+    return freeMemory;
+}
+
+void* task_alloc_buffer(u32 size) {
+    if(size == 0) {
+        return NULL;
+    }
+
+    svcWaitSynchronization(task_buffer_mutex, U64_MAX);
+
+    task_buffer* best = NULL;
+    task_buffer* slot = NULL;
+    for(u32 i = 0; i < BUFFER_POOL_SIZE; i++) {
+        task_buffer* curr = &task_buffers[i];
+        if(curr->inUse) {
+            continue;
+        }
+
+        if(curr->buffer == NULL) {
+            if(slot == NULL || slot->buffer != NULL) {
+                slot = curr;
+            }
+        } else if(curr->size >= size) {
+            if(best == NULL || curr->size < best->size) {
+                best = curr;
+            }
+        } else if(slot == NULL || (slot->buffer != NULL && curr->size < slot->size)) {
+            slot = curr;
+        }
+    }
+
+    void* buffer = NULL;
+    if(best != NULL) {
+        best->inUse = true;
+        buffer = best->buffer;
+    } else {
+        // Idle buffers that are too small to be reused are evicted before
+        // giving up on the allocation.
+        if(slot != NULL && slot->buffer != NULL) {
+            free(slot->buffer);
+            slot->buffer = NULL;
+            slot->size = 0;
+        }
+
+        if((buffer = memalign(BUFFER_ALIGNMENT, size)) == NULL) {
+            task_release_idle_buffers();
+            buffer = memalign(BUFFER_ALIGNMENT, size);
+        }
+
+        if(buffer != NULL && slot != NULL) {
+            slot->buffer = buffer;
+            slot->size = size;
+            slot->inUse = true;
+        }
+    }
+
+    svcReleaseMutex(task_buffer_mutex);
+
+    return buffer;
+}
+
+void task_free_buffer(void* buffer) {
+    if(buffer == NULL) {
+        return;
+    }
+
+    svcWaitSynchronization(task_buffer_mutex, U64_MAX);
+
+    task_buffer* pooled = NULL;
+    for(u32 i = 0; i < BUFFER_POOL_SIZE; i++) {
+        if(task_buffers[i].buffer == buffer) {
+            pooled = &task_buffers[i];
+            break;
+        }
+    }
+
+    if(pooled != NULL) {
+        pooled->inUse = false;
+
+        if(task_get_idle_buffer_size() > BUFFER_POOL_IDLE_MAX) {
+            free(pooled->buffer);
+            pooled->buffer = NULL;
+            pooled->size = 0;
+        }
+    } else {
+        free(buffer);
+    }
+
+    svcReleaseMutex(task_buffer_mutex);
+}
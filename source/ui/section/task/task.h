@@ -76,6 +76,8 @@ typedef struct {
     s16 height;
 
     Handle mutex;
+    // Counts frames copied to buffer, so readers can skip ones already seen.
+    volatile u32 frame;
 
     volatile bool finished;
     Result result;
@@ -92,12 +94,26 @@ typedef struct data_op_info_s {
 
     data_op op;
 
+    // Items processed at once; 0 or 1 processes them one at a time.
+    u32 concurrency;
+
+    // Log per-stage timings to /fbi/logs/; also on whenever that folder exists.
+    bool logStats;
+
     // Copy
     bool copyEmpty;
 
+    // Streaming source; readSrc fills the engine's buffer in place and may
+    // return short reads, so it is called again until each chunk is full.
+    bool fillSrc;
+
     u32 processed;
     u32 total;
 
+    // Lowest index still in flight, for showing the current item; items
+    // processed at once may finish out of order.
+    u32 current;
+
     u64 currProcessed;
     u64 currTotal;
 
@@ -115,6 +131,17 @@ typedef struct data_op_info_s {
 
     Result (*writeDst)(void* data, u32 handle, u32* bytesWritten, void* buffer, u64 offset, u32 size);
 
+    // Resume; optional, copies are journaled to the SD card when all are set.
+    // readSrc must then accept any offset. Journals left by an earlier copy
+    // are only picked up when resume is set, and discarded otherwise.
+    bool resume;
+    Result (*getJournalId)(void* data, u32 index, char* id, u32 size);
+    Result (*reopenDst)(void* data, u32 index, u32* handle);
+    Result (*readDst)(void* data, u32 handle, u32* bytesRead, void* buffer, u64 offset, u32 size);
+
+    // Hashing; optional, given the SHA-256 and CRC32 of each item written in full, before closeDst.
+    Result (*hashDst)(void* data, u32 index, u8* sha256, u32 crc32);
+
     // Delete
     Result (*delete)(void* data, u32 index);
 
@@ -195,8 +222,13 @@ void task_exit();
 bool task_is_quit_all();
 Handle task_get_pause_event();
 
+u32 task_get_free_buffer_memory();
+void* task_alloc_buffer(u32 size);
+void task_free_buffer(void* buffer);
+
 Result task_capture_cam(capture_cam_data* data);
 
+bool task_data_op_has_journal(data_op_data* data);
 Result task_data_op(data_op_data* data);
 
 void task_free_ext_save_data(list_item* item);
@@ -13,6 +13,7 @@
 #include "../../core/screen.h"
 
 static list_item install_from_cdn = {"Install from CDN", COLOR_TEXT, action_install_cdn};
+static list_item install_all_from_cdn = {"Install All from CDN", COLOR_TEXT, action_install_cdns};
 static list_item delete_ticket = {"Delete Ticket", COLOR_TEXT, action_delete_ticket};
 
 typedef struct {
@@ -57,6 +58,7 @@ static void tickets_action_update(ui_view* view, void* data, linked_list* items,
 
     if(linked_list_size(items) == 0) {
         linked_list_add(items, &install_from_cdn);
+        linked_list_add(items, &install_all_from_cdn);
         linked_list_add(items, &delete_ticket);
     }
 }
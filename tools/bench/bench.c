@@ -0,0 +1,453 @@
+// Host benchmark of the data op engine. Each configuration copies a set of
+// items from a modelled source to a modelled sink and reports throughput and
+// wall time per item; with the mem source and tiny items, the latter is the
+// engine's own per-item overhead.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <3ds.h>
+
+#include "../host/host.h"
+#include "../../source/ui/section/task/task.h"
+
+#define MIB (1024ULL * 1024ULL)
+
+#define PATTERN_SIZE (1024 * 1024)
+
+#define RINGS_MAX 8
+#define WORKERS_MAX 8
+
+#define TINY_ITEMS 1024
+#define TINY_SIZE 1024
+#define SMALL_SIZE (64 * 1024)
+#define LARGE_SIZE (16 * MIB)
+#define MIXED_MIN (4 * 1024)
+#define MIXED_MAX (8 * MIB)
+
+// Cost model of a source or destination: a fixed cost per item opened,
+// another per read or write call, and a transfer rate (0 for unlimited).
+typedef struct {
+    const char* name;
+
+    u64 openNs;
+    u64 callNs;
+    u64 bytesPerSec;
+
+    // Bytes copied per run when -m is not given.
+    u64 defaultTotal;
+} bench_device;
+
+static const bench_device sources[] = {
+    {"mem", 0, 0, 0, 256 * MIB},
+    {"sd", 2000000, 300000, 20 * MIB, 32 * MIB},
+    {"http", 60000000, 1000000, 4 * MIB, 8 * MIB}
+};
+
+static const bench_device sinks[] = {
+    {"null", 0, 0, 0, 0},
+    {"sd", 2000000, 300000, 12 * MIB, 0}
+};
+
+static const char* dists[] = {"large", "small", "tiny", "mixed"};
+
+typedef struct {
+    const bench_device* source;
+    const bench_device* sink;
+
+    u64* sizes;
+    u32 count;
+    u64 totalSize;
+
+    u8* pattern;
+
+    data_op_data info;
+} bench_data;
+
+static u64 bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64) ts.tv_sec * 1000000000ULL + (u64) ts.tv_nsec;
+}
+
+static void bench_delay(const bench_device* device, u64 fixedNs, u32 size) {
+    u64 ns = fixedNs;
+    if(device->bytesPerSec != 0) {
+        ns += size * 1000000000ULL / device->bytesPerSec;
+    }
+
+    if(ns != 0) {
+        svcSleepThread((s64) ns);
+    }
+}
+
+static Result bench_is_src_directory(void* data, u32 index, bool* isDirectory) {
+    (void) data;
+    (void) index;
+
+    *isDirectory = false;
+    return 0;
+}
+
+static Result bench_make_dst_directory(void* data, u32 index) {
+    (void) data;
+    (void) index;
+
+    return 0;
+}
+
+static Result bench_open_src(void* data, u32 index, u32* handle) {
+    bench_data* benchData = (bench_data*) data;
+
+    bench_delay(benchData->source, benchData->source->openNs, 0);
+
+    *handle = index;
+    return 0;
+}
+
+static Result bench_close_src(void* data, u32 index, bool succeeded, u32 handle) {
+    (void) data;
+    (void) index;
+    (void) succeeded;
+    (void) handle;
+
+    return 0;
+}
+
+static Result bench_get_src_size(void* data, u32 handle, u64* size) {
+    bench_data* benchData = (bench_data*) data;
+
+    *size = benchData->sizes[handle];
+    return 0;
+}
+
+static Result bench_read_src(void* data, u32 handle, u32* bytesRead, void* buffer, u64 offset, u32 size) {
+    bench_data* benchData = (bench_data*) data;
+
+    u64 remaining = benchData->sizes[handle] - offset;
+    if(size > remaining) {
+        size = (u32) remaining;
+    }
+
+    bench_delay(benchData->source, benchData->source->callNs, size);
+
+    for(u32 copied = 0; copied < size; ) {
+        u32 patternOffset = (u32) ((offset + copied) % PATTERN_SIZE);
+
+        u32 currSize = PATTERN_SIZE - patternOffset;
+        if(currSize > size - copied) {
+            currSize = size - copied;
+        }
+
+        memcpy((u8*) buffer + copied, benchData->pattern + patternOffset, currSize);
+        copied += currSize;
+    }
+
+    *bytesRead = size;
+    return 0;
+}
+
+static Result bench_open_dst(void* data, u32 index, void* initialReadBlock, u32* handle) {
+    bench_data* benchData = (bench_data*) data;
+
+    (void) initialReadBlock;
+
+    bench_delay(benchData->sink, benchData->sink->openNs, 0);
+
+    *handle = index;
+    return 0;
+}
+
+static Result bench_close_dst(void* data, u32 index, bool succeeded, u32 handle) {
+    (void) data;
+    (void) index;
+    (void) succeeded;
+    (void) handle;
+
+    return 0;
+}
+
+static Result bench_write_dst(void* data, u32 handle, u32* bytesWritten, void* buffer, u64 offset, u32 size) {
+    bench_data* benchData = (bench_data*) data;
+
+    (void) handle;
+    (void) buffer;
+    (void) offset;
+
+    bench_delay(benchData->sink, benchData->sink->callNs, size);
+
+    *bytesWritten = size;
+    return 0;
+}
+
+static Result bench_hash_dst(void* data, u32 index, u8* sha256, u32 crc32) {
+    (void) data;
+    (void) index;
+    (void) sha256;
+    (void) crc32;
+
+    return 0;
+}
+
+static bool bench_error(void* data, u32 index, Result res) {
+    (void) data;
+
+    fprintf(stderr, "item %u failed: 0x%08X\n", (unsigned int) index, (unsigned int) res);
+    return false;
+}
+
+// Item sizes follow the distribution; mixed is log-uniform between
+// MIXED_MIN and MIXED_MAX, from a fixed seed so every run copies the same set.
+static bool bench_make_sizes(bench_data* data, const char* dist, u64 total) {
+    u32 max = 0;
+    if(strcmp(dist, "large") == 0) {
+        max = (u32) ((total + LARGE_SIZE - 1) / LARGE_SIZE);
+    } else if(strcmp(dist, "small") == 0) {
+        max = (u32) ((total + SMALL_SIZE - 1) / SMALL_SIZE);
+    } else if(strcmp(dist, "tiny") == 0) {
+        max = TINY_ITEMS;
+    } else if(strcmp(dist, "mixed") == 0) {
+        max = (u32) (total / MIXED_MIN + 1);
+    } else {
+        return false;
+    }
+
+    data->sizes = (u64*) calloc(max, sizeof(u64));
+    if(data->sizes == NULL) {
+        return false;
+    }
+
+    u32 seed = 0x46424921;
+    while(data->count < max && (strcmp(dist, "tiny") == 0 || data->totalSize < total)) {
+        u64 size = 0;
+        if(strcmp(dist, "large") == 0) {
+            size = LARGE_SIZE;
+        } else if(strcmp(dist, "small") == 0) {
+            size = SMALL_SIZE;
+        } else if(strcmp(dist, "tiny") == 0) {
+            size = TINY_SIZE;
+        } else {
+            seed = seed * 1664525 + 1013904223;
+
+            double exponent = (double) (seed >> 8) / (double) (1 << 24);
+            size = (u64) ((double) MIXED_MIN * pow((double) MIXED_MAX / MIXED_MIN, exponent));
+        }
+
+        if(strcmp(dist, "tiny") != 0 && size > total - data->totalSize) {
+            size = total - data->totalSize;
+        }
+
+        data->sizes[data->count++] = size;
+        data->totalSize += size;
+    }
+
+    return true;
+}
+
+// Runs in its own process, so the engine's remembered chunk sizes start out
+// untuned for every configuration.
+static int bench_run(const bench_device* source, const bench_device* sink, const char* dist, u64 total, u32 ringKiB, u32 workers, bool hash) {
+    bench_data data;
+    memset(&data, 0, sizeof(data));
+
+    data.source = source;
+    data.sink = sink;
+
+    data.pattern = (u8*) malloc(PATTERN_SIZE);
+    if(data.pattern == NULL || !bench_make_sizes(&data, dist, total)) {
+        fprintf(stderr, "Failed to set up %s items.\n", dist);
+        return 1;
+    }
+
+    for(u32 i = 0; i < PATTERN_SIZE; i++) {
+        data.pattern[i] = (u8) (i * 31 + (i >> 8));
+    }
+
+    // The engine splits a quarter of the free heap across the workers' four-slot rings.
+    host_init(ringKiB * 1024 * 16 * workers);
+
+    data.info.data = &data;
+
+    data.info.op = DATAOP_COPY;
+    data.info.concurrency = workers;
+
+    data.info.copyEmpty = true;
+
+    data.info.total = data.count;
+
+    data.info.isSrcDirectory = bench_is_src_directory;
+    data.info.makeDstDirectory = bench_make_dst_directory;
+
+    data.info.openSrc = bench_open_src;
+    data.info.closeSrc = bench_close_src;
+    data.info.getSrcSize = bench_get_src_size;
+    data.info.readSrc = bench_read_src;
+
+    data.info.openDst = bench_open_dst;
+    data.info.closeDst = bench_close_dst;
+    data.info.writeDst = bench_write_dst;
+
+    if(hash) {
+        data.info.hashDst = bench_hash_dst;
+    }
+
+    data.info.error = bench_error;
+
+    u64 start = bench_now_ns();
+
+    Result res = task_data_op(&data.info);
+    if(R_FAILED(res)) {
+        fprintf(stderr, "Failed to start data op: 0x%08X\n", (unsigned int) res);
+        return 1;
+    }
+
+    while(!data.info.finished) {
+        svcSleepThread(100000);
+    }
+
+    double secs = (bench_now_ns() - start) / 1000000000.0;
+
+    if(R_FAILED(data.info.result) || data.info.processed != data.count) {
+        fprintf(stderr, "Data op failed after %u of %u items: 0x%08X\n", (unsigned int) data.info.processed, (unsigned int) data.count, (unsigned int) data.info.result);
+        return 1;
+    }
+
+    printf("%-6s %-6s %-6s %7u %7u %7u %9.2f %8.3f %9.2f %10.1f\n", source->name, sink->name, dist, (unsigned int) ringKiB, (unsigned int) workers, (unsigned int) data.count,
+           data.totalSize / (double) MIB, secs, data.totalSize / (double) MIB / secs, secs * 1000000.0 / data.count);
+    fflush(stdout);
+
+    free(data.sizes);
+    free(data.pattern);
+
+    return 0;
+}
+
+static const bench_device* bench_find_device(const bench_device* devices, u32 count, const char* name) {
+    for(u32 i = 0; i < count; i++) {
+        if(strcmp(devices[i].name, name) == 0) {
+            return &devices[i];
+        }
+    }
+
+    return NULL;
+}
+
+static u32 bench_parse_list(char* list, u32* values, u32 max) {
+    u32 count = 0;
+    for(char* token = strtok(list, ","); token != NULL && count < max; token = strtok(NULL, ",")) {
+        u32 value = (u32) strtoul(token, NULL, 0);
+        if(value > 0) {
+            values[count++] = value;
+        }
+    }
+
+    return count;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-s source] [-o sink] [-d dist] [-b ring sizes] [-c workers] [-m MiB] [-H]\n", name);
+    fprintf(stderr, "  -s  mem, sd or http (default mem)\n");
+    fprintf(stderr, "  -o  null or sd (default null)\n");
+    fprintf(stderr, "  -d  large, small, tiny, mixed or all (default all)\n");
+    fprintf(stderr, "  -b  ring slot sizes in KiB, comma separated (default 64,256,1024)\n");
+    fprintf(stderr, "  -c  worker counts, comma separated (default 1,2,4)\n");
+    fprintf(stderr, "  -m  MiB copied per run (default depends on the source)\n");
+    fprintf(stderr, "  -H  hash each item as it is written\n");
+}
+
+int main(int argc, char** argv) {
+    const bench_device* source = &sources[0];
+    const bench_device* sink = &sinks[0];
+    const char* dist = "all";
+
+    u32 rings[RINGS_MAX] = {64, 256, 1024};
+    u32 ringCount = 3;
+
+    u32 workers[WORKERS_MAX] = {1, 2, 4};
+    u32 workerCount = 3;
+
+    u64 total = 0;
+    bool hash = false;
+
+    int opt;
+    while((opt = getopt(argc, argv, "s:o:d:b:c:m:H")) != -1) {
+        switch(opt) {
+            case 's':
+                source = bench_find_device(sources, sizeof(sources) / sizeof(*sources), optarg);
+                break;
+            case 'o':
+                sink = bench_find_device(sinks, sizeof(sinks) / sizeof(*sinks), optarg);
+                break;
+            case 'd':
+                dist = optarg;
+                break;
+            case 'b':
+                ringCount = bench_parse_list(optarg, rings, RINGS_MAX);
+                break;
+            case 'c':
+                workerCount = bench_parse_list(optarg, workers, WORKERS_MAX);
+                break;
+            case 'm':
+                total = strtoull(optarg, NULL, 0) * MIB;
+                break;
+            case 'H':
+                hash = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    bool distFound = strcmp(dist, "all") == 0;
+    for(u32 d = 0; d < sizeof(dists) / sizeof(*dists); d++) {
+        distFound |= strcmp(dist, dists[d]) == 0;
+    }
+
+    if(source == NULL || sink == NULL || !distFound || ringCount == 0 || workerCount == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(total == 0) {
+        total = source->defaultTotal;
+    }
+
+    printf("%-6s %-6s %-6s %7s %7s %7s %9s %8s %9s %10s\n", "source", "sink", "dist", "ringKiB", "workers", "items", "MiB", "secs", "MiB/s", "us/item");
+    fflush(stdout);
+
+    int failures = 0;
+    for(u32 d = 0; d < sizeof(dists) / sizeof(*dists); d++) {
+        if(strcmp(dist, "all") != 0 && strcmp(dist, dists[d]) != 0) {
+            continue;
+        }
+
+        for(u32 r = 0; r < ringCount; r++) {
+            for(u32 w = 0; w < workerCount; w++) {
+                pid_t pid = fork();
+                if(pid == 0) {
+                    exit(bench_run(source, sink, dists[d], total, rings[r], workers[w], hash));
+                }
+
+                int status = 0;
+                if(pid < 0 || waitpid(pid, &status, 0) < 0) {
+                    fprintf(stderr, "Failed to run %s items.\n", dists[d]);
+                    failures++;
+                } else if(WIFSIGNALED(status)) {
+                    fprintf(stderr, "Run with %s items, %u KiB rings and %u workers died on signal %d.\n", dists[d], (unsigned int) rings[r], (unsigned int) workers[w], WTERMSIG(status));
+                    failures++;
+                } else if(WEXITSTATUS(status) != 0) {
+                    failures++;
+                }
+            }
+        }
+    }
+
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,591 @@
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <3ds.h>
+
+#include "host.h"
+#include "../../source/core/util.h"
+
+#define OBJECTS_MAX 1024
+
+// What the kernel returns for a timed out wait; not a failure code.
+#define R_TIMEOUT 0x09401BFE
+#define R_INVALID_HANDLE MAKERESULT(RL_PERMANENT, RS_INVALIDARG, RM_APPLICATION, RD_NOT_FOUND)
+#define R_OUT_OF_HANDLES MAKERESULT(RL_FATAL, RS_OUTOFRESOURCE, RM_APPLICATION, RD_OUT_OF_MEMORY)
+#define R_NO_SD MAKERESULT(RL_PERMANENT, RS_NOTFOUND, RM_APPLICATION, RD_NOT_FOUND)
+
+typedef enum {
+    OBJECT_FREE,
+    OBJECT_EVENT,
+    OBJECT_MUTEX,
+    OBJECT_SEMAPHORE
+} object_type;
+
+typedef struct {
+    object_type type;
+
+    // Event
+    ResetType resetType;
+    bool signaled;
+
+    // Mutex; kernel mutexes may be re-locked by their owner.
+    pthread_t owner;
+    u32 lockCount;
+
+    // Semaphore
+    s32 count;
+    s32 maxCount;
+} object;
+
+// Every kernel object shares one lock and one condition; waiters recheck
+// their handles on each change. Contention is far below what the copy
+// callbacks cost, so this does not skew the measurements.
+static object objects[OBJECTS_MAX];
+static pthread_mutex_t objectLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t objectCond = PTHREAD_COND_INITIALIZER;
+
+struct Thread_tag {
+    pthread_t thread;
+
+    ThreadFunc entrypoint;
+    void* arg;
+    bool detached;
+
+    // libctru threads may be joined again once they have finished.
+    bool joined;
+};
+
+static Handle pauseEvent = 0;
+static u32 freeBufferMemory = 0;
+
+static u32 crc32Table[256];
+
+Result (*host_file_write)(Handle handle, u32* bytesWritten, u64 offset, const void* buffer, u32 size) = NULL;
+Result (*host_file_close)(Handle handle) = NULL;
+
+static u64 host_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64) ts.tv_sec * 1000000000ULL + (u64) ts.tv_nsec;
+}
+
+static object* host_get_object(Handle handle, object_type type) {
+    if(handle == 0 || handle > OBJECTS_MAX || objects[handle - 1].type != type) {
+        return NULL;
+    }
+
+    return &objects[handle - 1];
+}
+
+static Result host_create_object(Handle* handle, object_type type, object** out) {
+    for(u32 i = 0; i < OBJECTS_MAX; i++) {
+        if(objects[i].type == OBJECT_FREE) {
+            memset(&objects[i], 0, sizeof(object));
+            objects[i].type = type;
+
+            *handle = i + 1;
+            *out = &objects[i];
+            return 0;
+        }
+    }
+
+    return R_OUT_OF_HANDLES;
+}
+
+static bool host_try_acquire(object* obj) {
+    switch(obj->type) {
+        case OBJECT_EVENT:
+            if(!obj->signaled) {
+                return false;
+            }
+
+            if(obj->resetType == RESET_ONESHOT) {
+                obj->signaled = false;
+            }
+
+            return true;
+        case OBJECT_MUTEX:
+            if(obj->lockCount > 0 && !pthread_equal(obj->owner, pthread_self())) {
+                return false;
+            }
+
+            obj->owner = pthread_self();
+            obj->lockCount++;
+            return true;
+        case OBJECT_SEMAPHORE:
+            if(obj->count <= 0) {
+                return false;
+            }
+
+            obj->count--;
+            return true;
+        default:
+            return false;
+    }
+}
+
+Result svcCreateEvent(Handle* event, ResetType resetType) {
+    pthread_mutex_lock(&objectLock);
+
+    object* obj = NULL;
+    Result res = host_create_object(event, OBJECT_EVENT, &obj);
+    if(R_SUCCEEDED(res)) {
+        obj->resetType = resetType;
+    }
+
+    pthread_mutex_unlock(&objectLock);
+
+    return res;
+}
+
+Result svcSignalEvent(Handle handle) {
+    pthread_mutex_lock(&objectLock);
+
+    Result res = 0;
+
+    object* obj = host_get_object(handle, OBJECT_EVENT);
+    if(obj != NULL) {
+        obj->signaled = true;
+        pthread_cond_broadcast(&objectCond);
+    } else {
+        res = R_INVALID_HANDLE;
+    }
+
+    pthread_mutex_unlock(&objectLock);
+
+    return res;
+}
+
+Result svcClearEvent(Handle handle) {
+    pthread_mutex_lock(&objectLock);
+
+    Result res = 0;
+
+    object* obj = host_get_object(handle, OBJECT_EVENT);
+    if(obj != NULL) {
+        obj->signaled = false;
+    } else {
+        res = R_INVALID_HANDLE;
+    }
+
+    pthread_mutex_unlock(&objectLock);
+
+    return res;
+}
+
+Result svcCreateMutex(Handle* mutex, bool initiallyLocked) {
+    pthread_mutex_lock(&objectLock);
+
+    object* obj = NULL;
+    Result res = host_create_object(mutex, OBJECT_MUTEX, &obj);
+    if(R_SUCCEEDED(res) && initiallyLocked) {
+        obj->owner = pthread_self();
+        obj->lockCount = 1;
+    }
+
+    pthread_mutex_unlock(&objectLock);
+
+    return res;
+}
+
+Result svcReleaseMutex(Handle handle) {
+    pthread_mutex_lock(&objectLock);
+
+    Result res = 0;
+
+    object* obj = host_get_object(handle, OBJECT_MUTEX);
+    if(obj != NULL && obj->lockCount > 0 && pthread_equal(obj->owner, pthread_self())) {
+        if(--obj->lockCount == 0) {
+            pthread_cond_broadcast(&objectCond);
+        }
+    } else {
+        res = R_INVALID_HANDLE;
+    }
+
+    pthread_mutex_unlock(&objectLock);
+
+    return res;
+}
+
+Result svcCreateSemaphore(Handle* semaphore, s32 initialCount, s32 maxCount) {
+    pthread_mutex_lock(&objectLock);
+
+    object* obj = NULL;
+    Result res = host_create_object(semaphore, OBJECT_SEMAPHORE, &obj);
+    if(R_SUCCEEDED(res)) {
+        obj->count = initialCount;
+        obj->maxCount = maxCount;
+    }
+
+    pthread_mutex_unlock(&objectLock);
+
+    return res;
+}
+
+Result svcReleaseSemaphore(s32* count, Handle semaphore, s32 releaseCount) {
+    pthread_mutex_lock(&objectLock);
+
+    Result res = 0;
+
+    object* obj = host_get_object(semaphore, OBJECT_SEMAPHORE);
+    if(obj != NULL && obj->count + releaseCount <= obj->maxCount) {
+        *count = obj->count;
+        obj->count += releaseCount;
+
+        pthread_cond_broadcast(&objectCond);
+    } else {
+        res = R_INVALID_HANDLE;
+    }
+
+    pthread_mutex_unlock(&objectLock);
+
+    return res;
+}
+
+Result svcCloseHandle(Handle handle) {
+    pthread_mutex_lock(&objectLock);
+
+    Result res = 0;
+
+    if(handle != 0 && handle <= OBJECTS_MAX && objects[handle - 1].type != OBJECT_FREE) {
+        objects[handle - 1].type = OBJECT_FREE;
+        pthread_cond_broadcast(&objectCond);
+    } else {
+        res = R_INVALID_HANDLE;
+    }
+
+    pthread_mutex_unlock(&objectLock);
+
+    return res;
+}
+
+Result svcWaitSynchronizationN(s32* out, const Handle* handles, s32 handlesNum, bool waitAll, s64 nanoseconds) {
+    (void) waitAll;
+
+    struct timespec deadline;
+    if(nanoseconds > 0) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+
+        u64 ns = (u64) deadline.tv_nsec + (u64) nanoseconds;
+        deadline.tv_sec += (time_t) (ns / 1000000000ULL);
+        deadline.tv_nsec = (long) (ns % 1000000000ULL);
+    }
+
+    pthread_mutex_lock(&objectLock);
+
+    Result res = 0;
+    while(true) {
+        s32 index = -1;
+        for(s32 i = 0; i < handlesNum; i++) {
+            if(handles[i] == 0 || handles[i] > OBJECTS_MAX || objects[handles[i] - 1].type == OBJECT_FREE) {
+                res = R_INVALID_HANDLE;
+                break;
+            }
+
+            if(host_try_acquire(&objects[handles[i] - 1])) {
+                index = i;
+                break;
+            }
+        }
+
+        if(R_FAILED(res) || index >= 0) {
+            if(out != NULL) {
+                *out = index;
+            }
+
+            break;
+        }
+
+        if(nanoseconds == 0) {
+            res = R_TIMEOUT;
+            break;
+        }
+
+        if(nanoseconds < 0) {
+            pthread_cond_wait(&objectCond, &objectLock);
+        } else if(pthread_cond_timedwait(&objectCond, &objectLock, &deadline) == ETIMEDOUT) {
+            res = R_TIMEOUT;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&objectLock);
+
+    return res;
+}
+
+Result svcWaitSynchronization(Handle handle, s64 nanoseconds) {
+    return svcWaitSynchronizationN(NULL, &handle, 1, false, nanoseconds);
+}
+
+void svcSleepThread(s64 ns) {
+    struct timespec ts = {(time_t) (ns / 1000000000LL), (long) (ns % 1000000000LL)};
+    while(nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+u64 svcGetSystemTick(void) {
+    return (u64) ((unsigned __int128) host_now_ns() * SYSCLOCK_ARM11 / 1000000000ULL);
+}
+
+static void* host_thread_entry(void* arg) {
+    Thread thread = (Thread) arg;
+
+    thread->entrypoint(thread->arg);
+
+    if(thread->detached) {
+        free(thread);
+    }
+
+    return NULL;
+}
+
+Thread threadCreate(ThreadFunc entrypoint, void* arg, size_t stackSize, int prio, int coreId, bool detached) {
+    (void) stackSize;
+    (void) prio;
+    (void) coreId;
+
+    Thread thread = (Thread) calloc(1, sizeof(struct Thread_tag));
+    if(thread == NULL) {
+        return NULL;
+    }
+
+    thread->entrypoint = entrypoint;
+    thread->arg = arg;
+    thread->detached = detached;
+
+    // Detached from the start; a detached thread may exit and free itself
+    // before pthread_create returns.
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, detached ? PTHREAD_CREATE_DETACHED : PTHREAD_CREATE_JOINABLE);
+
+    int err = pthread_create(&thread->thread, &attr, host_thread_entry, thread);
+    pthread_attr_destroy(&attr);
+
+    if(err != 0) {
+        free(thread);
+        return NULL;
+    }
+
+    return thread;
+}
+
+Result threadJoin(Thread thread, u64 timeoutNs) {
+    (void) timeoutNs;
+
+    if(!thread->joined) {
+        pthread_join(thread->thread, NULL);
+        thread->joined = true;
+    }
+
+    return 0;
+}
+
+void threadFree(Thread thread) {
+    free(thread);
+}
+
+u64 osGetTime(void) {
+    return host_now_ns() / 1000000ULL;
+}
+
+void aptSetSleepAllowed(bool allowed) {
+    (void) allowed;
+}
+
+Result APT_CheckNew3DS(u8* out) {
+    *out = true;
+    return 0;
+}
+
+ssize_t utf16_to_utf8(uint8_t* out, const uint16_t* in, size_t len) {
+    size_t i = 0;
+    for(; i < len && in[i] != 0; i++) {
+        out[i] = in[i] < 0x80 ? (uint8_t) in[i] : '?';
+    }
+
+    return (ssize_t) i;
+}
+
+long host_gethostid(void) {
+    return (long) htonl(INADDR_LOOPBACK);
+}
+
+#undef bind
+
+int host_bind(int sockfd, const struct sockaddr* addr, socklen_t addrlen) {
+    int reuse = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    return bind(sockfd, addr, addrlen);
+}
+
+FS_Path fsMakePath(FS_PathType type, const void* path) {
+    FS_Path fsPath = {type, path != NULL ? (u32) strlen((const char*) path) + 1 : 0, path};
+    return fsPath;
+}
+
+Result FSUSER_OpenArchive(FS_Archive* archive, FS_ArchiveID id, FS_Path path) {
+    (void) archive;
+    (void) id;
+    (void) path;
+
+    return R_NO_SD;
+}
+
+Result FSUSER_CloseArchive(FS_Archive archive) {
+    (void) archive;
+
+    return R_NO_SD;
+}
+
+Result FSUSER_OpenFile(Handle* out, FS_Archive archive, FS_Path path, u32 openFlags, u32 attributes) {
+    (void) out;
+    (void) archive;
+    (void) path;
+    (void) openFlags;
+    (void) attributes;
+
+    return R_NO_SD;
+}
+
+Result FSUSER_DeleteFile(FS_Archive archive, FS_Path path) {
+    (void) archive;
+    (void) path;
+
+    return R_NO_SD;
+}
+
+Result FSUSER_OpenDirectory(Handle* out, FS_Archive archive, FS_Path path) {
+    (void) out;
+    (void) archive;
+    (void) path;
+
+    return R_NO_SD;
+}
+
+Result FSFILE_Read(Handle handle, u32* bytesRead, u64 offset, void* buffer, u32 size) {
+    (void) handle;
+    (void) bytesRead;
+    (void) offset;
+    (void) buffer;
+    (void) size;
+
+    return R_NO_SD;
+}
+
+Result FSFILE_Write(Handle handle, u32* bytesWritten, u64 offset, const void* buffer, u32 size, u32 flags) {
+    (void) flags;
+
+    if(host_file_write != NULL) {
+        return host_file_write(handle, bytesWritten, offset, buffer, size);
+    }
+
+    return R_NO_SD;
+}
+
+Result FSFILE_Close(Handle handle) {
+    if(host_file_close != NULL) {
+        return host_file_close(handle);
+    }
+
+    return R_NO_SD;
+}
+
+Result FSDIR_Read(Handle handle, u32* entriesRead, u32 entryCount, FS_DirectoryEntry* entries) {
+    (void) handle;
+    (void) entriesRead;
+    (void) entryCount;
+    (void) entries;
+
+    return R_NO_SD;
+}
+
+Result FSDIR_Close(Handle handle) {
+    (void) handle;
+
+    return R_NO_SD;
+}
+
+// FBI's task and util helpers the engine calls.
+
+void host_init(u32 bufferMemory) {
+    freeBufferMemory = bufferMemory;
+
+    for(u32 i = 0; i < 256; i++) {
+        u32 crc = i;
+        for(u32 bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320 : 0);
+        }
+
+        crc32Table[i] = crc;
+    }
+
+    svcCreateEvent(&pauseEvent, RESET_STICKY);
+    svcSignalEvent(pauseEvent);
+}
+
+bool task_is_quit_all() {
+    return false;
+}
+
+Handle task_get_pause_event() {
+    return pauseEvent;
+}
+
+u32 task_get_free_buffer_memory() {
+    return freeBufferMemory;
+}
+
+void* task_alloc_buffer(u32 size) {
+    return malloc(size);
+}
+
+void task_free_buffer(void* buffer) {
+    free(buffer);
+}
+
+FS_Path* util_make_path_utf8(const char* path) {
+    FS_Path* fsPath = (FS_Path*) malloc(sizeof(FS_Path));
+    if(fsPath != NULL) {
+        *fsPath = fsMakePath(PATH_ASCII, path);
+    }
+
+    return fsPath;
+}
+
+void util_free_path_utf8(FS_Path* path) {
+    free(path);
+}
+
+bool util_is_dir(FS_Archive archive, const char* path) {
+    (void) archive;
+    (void) path;
+
+    return false;
+}
+
+Result util_ensure_dir(FS_Archive archive, const char* path) {
+    (void) archive;
+    (void) path;
+
+    return R_NO_SD;
+}
+
+u32 util_crc32(u32 crc, const void* data, u32 size) {
+    const u8* bytes = (const u8*) data;
+
+    crc = ~crc;
+    for(u32 i = 0; i < size; i++) {
+        crc = crc32Table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <3ds.h>
+
+// Sets up the stand-ins in host.c; bufferMemory is what the copy engine sees
+// as free heap when sizing its buffers.
+void host_init(u32 bufferMemory);
+
+// Optional; receives FSFILE_Write and FSFILE_Close calls, for handles a
+// harness hands out itself. Without it there is no SD card to write to.
+extern Result (*host_file_write)(Handle handle, u32* bytesWritten, u64 offset, const void* buffer, u32 size);
+extern Result (*host_file_close)(Handle handle);
@@ -0,0 +1,214 @@
+#pragma once
+
+// Host stand-in for the parts of libctru that FBI's host tools build against.
+// host.c implements the kernel, FS and APT calls on pthreads; AM, HID, httpc
+// and the UI are left to each harness.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+typedef s32 Result;
+typedef u32 Handle;
+
+#define U64_MAX UINT64_MAX
+
+#define SYSCLOCK_ARM11 268111856ULL
+
+#define R_SUCCEEDED(res) ((res) >= 0)
+#define R_FAILED(res) ((res) < 0)
+
+#define MAKERESULT(level, summary, module, description) \
+    ((((level) & 0x1F) << 27) | (((summary) & 0x3F) << 21) | (((module) & 0xFF) << 10) | ((description) & 0x3FF))
+
+enum {
+    RL_PERMANENT = 27,
+    RL_FATAL = 31
+};
+
+enum {
+    RS_CANCELED = 1,
+    RS_OUTOFRESOURCE = 3,
+    RS_NOTFOUND = 4,
+    RS_INVALIDSTATE = 5,
+    RS_NOTSUPPORTED = 6,
+    RS_INVALIDARG = 7,
+    RS_INTERNAL = 11
+};
+
+enum {
+    RM_APPLICATION = 254
+};
+
+enum {
+    RD_OUT_OF_RANGE = 1021,
+    RD_NOT_FOUND = 1018,
+    RD_OUT_OF_MEMORY = 1011
+};
+
+typedef enum {
+    RESET_ONESHOT = 0,
+    RESET_STICKY = 1,
+    RESET_PULSE = 2
+} ResetType;
+
+Result svcCreateEvent(Handle* event, ResetType resetType);
+Result svcSignalEvent(Handle handle);
+Result svcClearEvent(Handle handle);
+Result svcCreateMutex(Handle* mutex, bool initiallyLocked);
+Result svcReleaseMutex(Handle handle);
+Result svcCreateSemaphore(Handle* semaphore, s32 initialCount, s32 maxCount);
+Result svcReleaseSemaphore(s32* count, Handle semaphore, s32 releaseCount);
+Result svcCloseHandle(Handle handle);
+Result svcWaitSynchronization(Handle handle, s64 nanoseconds);
+Result svcWaitSynchronizationN(s32* out, const Handle* handles, s32 handlesNum, bool waitAll, s64 nanoseconds);
+void svcSleepThread(s64 ns);
+u64 svcGetSystemTick(void);
+
+typedef struct Thread_tag* Thread;
+typedef void (*ThreadFunc)(void* arg);
+
+Thread threadCreate(ThreadFunc entrypoint, void* arg, size_t stackSize, int prio, int coreId, bool detached);
+Result threadJoin(Thread thread, u64 timeoutNs);
+void threadFree(Thread thread);
+
+u64 osGetTime(void);
+
+void aptSetSleepAllowed(bool allowed);
+Result APT_CheckNew3DS(u8* out);
+
+ssize_t utf16_to_utf8(uint8_t* out, const uint16_t* in, size_t len);
+
+typedef struct {
+    Handle servhandle;
+    u32 httphandle;
+} httpcContext;
+
+typedef enum {
+    HTTPC_METHOD_GET = 1
+} HTTPC_RequestMethod;
+
+#define SSLCOPT_DisableVerify (1 << 9)
+
+#define HTTPC_RESULTCODE_DOWNLOADPENDING ((Result) 0xD840A02B)
+
+Result httpcOpenContext(httpcContext* context, HTTPC_RequestMethod method, const char* url, u32 use_defaultproxy);
+Result httpcCloseContext(httpcContext* context);
+Result httpcSetSSLOpt(httpcContext* context, u32 options);
+Result httpcAddRequestHeaderField(httpcContext* context, const char* name, const char* value);
+Result httpcBeginRequest(httpcContext* context);
+Result httpcGetResponseStatusCode(httpcContext* context, u32* out, u64 delay);
+Result httpcGetResponseHeader(httpcContext* context, const char* name, char* value, u32 valuebuf_maxsize);
+Result httpcGetDownloadSizeState(httpcContext* context, u32* downloadedsize, u32* contentsize);
+Result httpcDownloadData(httpcContext* context, u8* buffer, u32 size, u32* downloadedsize);
+
+// The 3DS reports its own IPv4 address; host.c reports the loopback address.
+long host_gethostid(void);
+#define gethostid host_gethostid
+
+// The console has no TIME_WAIT to speak of; host.c lets back to back runs
+// rebind the same port.
+int host_bind(int sockfd, const struct sockaddr* addr, socklen_t addrlen);
+#define bind host_bind
+
+// Graphics types the UI headers mention.
+typedef enum {
+    GFX_TOP = 0,
+    GFX_BOTTOM = 1
+} gfxScreen_t;
+
+typedef enum {
+    GPU_RGBA8 = 0
+} GPU_TEXCOLOR;
+
+// HID; implemented by the harness.
+#define KEY_A (1 << 0)
+#define KEY_B (1 << 1)
+
+u32 hidKeysDown(void);
+
+// FS; there is no SD card, so every archive fails to open.
+typedef u64 FS_Archive;
+
+typedef enum {
+    MEDIATYPE_NAND = 0,
+    MEDIATYPE_SD = 1,
+    MEDIATYPE_GAME_CARD = 2
+} FS_MediaType;
+
+typedef enum {
+    ARCHIVE_SDMC = 0x00000009
+} FS_ArchiveID;
+
+typedef enum {
+    PATH_INVALID = 0,
+    PATH_EMPTY = 1,
+    PATH_BINARY = 2,
+    PATH_ASCII = 3,
+    PATH_UTF16 = 4
+} FS_PathType;
+
+typedef struct {
+    FS_PathType type;
+    u32 size;
+    const void* data;
+} FS_Path;
+
+enum {
+    FS_OPEN_READ = 1,
+    FS_OPEN_WRITE = 2,
+    FS_OPEN_CREATE = 4
+};
+
+enum {
+    FS_WRITE_FLUSH = 1
+};
+
+typedef struct {
+    u16 name[0x106];
+    char shortName[0x0A];
+    char shortExt[0x04];
+    u8 valid;
+    u8 reserved;
+    u32 attributes;
+    u64 fileSize;
+} FS_DirectoryEntry;
+
+FS_Path fsMakePath(FS_PathType type, const void* path);
+
+Result FSUSER_OpenArchive(FS_Archive* archive, FS_ArchiveID id, FS_Path path);
+Result FSUSER_CloseArchive(FS_Archive archive);
+Result FSUSER_OpenFile(Handle* out, FS_Archive archive, FS_Path path, u32 openFlags, u32 attributes);
+Result FSUSER_DeleteFile(FS_Archive archive, FS_Path path);
+Result FSUSER_OpenDirectory(Handle* out, FS_Archive archive, FS_Path path);
+
+Result FSFILE_Read(Handle handle, u32* bytesRead, u64 offset, void* buffer, u32 size);
+Result FSFILE_Write(Handle handle, u32* bytesWritten, u64 offset, const void* buffer, u32 size, u32 flags);
+Result FSFILE_Close(Handle handle);
+
+Result FSDIR_Read(Handle handle, u32* entriesRead, u32 entryCount, FS_DirectoryEntry* entries);
+Result FSDIR_Close(Handle handle);
+
+// AM; implemented by the harness.
+Result AM_StartCiaInstall(FS_MediaType mediaType, Handle* ciaHandle);
+Result AM_FinishCiaInstall(Handle ciaHandle);
+Result AM_CancelCIAInstall(Handle ciaHandle);
+Result AM_InstallTicketBegin(Handle* ticketHandle);
+Result AM_InstallTicketFinish(Handle ticketHandle);
+Result AM_InstallTicketAbort(Handle ticketHandle);
+Result AM_DeleteTitle(FS_MediaType mediaType, u64 titleId);
+Result AM_DeleteTicket(u64 ticketId);
+Result AM_QueryAvailableExternalTitleDatabase(bool* available);
+Result AM_InstallFirm(u64 titleId);
@@ -0,0 +1,381 @@
+// Host test of http_stream's reconnect logic (source/core/http.c), against a
+// scripted stand-in for httpc. Back-off sleeps are recorded, not slept.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <3ds.h>
+
+#include "../../source/core/http.h"
+#include "../../source/ui/error.h"
+
+#define BODY_SIZE (64 * 1024)
+#define READ_SIZE (4 * 1024)
+#define SCRIPT_MAX 8
+#define SLEEPS_MAX 16
+
+#define DROP_OFFSET 10000
+#define ETAG "\"v1\""
+
+#define R_TEST_DROPPED MAKERESULT(RL_PERMANENT, RS_INTERNAL, RM_APPLICATION, 0x3FF)
+
+// One scripted request; a code of 0 answers like a server that honours Range
+// and If-Range.
+typedef struct {
+    u32 code;
+
+    // Bytes served before the connection drops; 0 never drops.
+    u32 dropAfter;
+} test_response;
+
+static struct {
+    u8 body[BODY_SIZE];
+    char etag[HTTP_ETAG_MAX];
+    bool ranges;
+
+    test_response script[SCRIPT_MAX];
+    u32 scriptCount;
+    u32 requests;
+
+    // The request under way.
+    char range[32];
+    char ifRange[HTTP_ETAG_MAX];
+    u32 code;
+    u64 start;
+    u64 served;
+    u32 dropAfter;
+
+    s64 sleeps[SLEEPS_MAX];
+    u32 sleepCount;
+} server;
+
+static const char* currentTest = NULL;
+static u32 failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if(!(cond)) { \
+            fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, currentTest, #cond); \
+            failures++; \
+        } \
+    } while(0)
+
+void svcSleepThread(s64 ns) {
+    if(server.sleepCount < SLEEPS_MAX) {
+        server.sleeps[server.sleepCount] = ns;
+    }
+
+    server.sleepCount++;
+}
+
+Result httpcOpenContext(httpcContext* context, HTTPC_RequestMethod method, const char* url, u32 use_defaultproxy) {
+    (void) context;
+    (void) method;
+    (void) url;
+    (void) use_defaultproxy;
+
+    server.range[0] = '\0';
+    server.ifRange[0] = '\0';
+    server.code = 0;
+    server.start = 0;
+    server.served = 0;
+    server.dropAfter = 0;
+
+    return 0;
+}
+
+Result httpcCloseContext(httpcContext* context) {
+    (void) context;
+
+    return 0;
+}
+
+Result httpcSetSSLOpt(httpcContext* context, u32 options) {
+    (void) context;
+    (void) options;
+
+    return 0;
+}
+
+Result httpcAddRequestHeaderField(httpcContext* context, const char* name, const char* value) {
+    (void) context;
+
+    if(strcmp(name, "Range") == 0) {
+        snprintf(server.range, sizeof(server.range), "%s", value);
+    } else if(strcmp(name, "If-Range") == 0) {
+        snprintf(server.ifRange, sizeof(server.ifRange), "%s", value);
+    }
+
+    return 0;
+}
+
+Result httpcBeginRequest(httpcContext* context) {
+    (void) context;
+
+    test_response response = {0, 0};
+    if(server.requests < server.scriptCount) {
+        response = server.script[server.requests];
+    }
+
+    server.requests++;
+
+    unsigned long long start = 0;
+    bool ranged = server.range[0] != '\0' && sscanf(server.range, "bytes=%llu-", &start) == 1;
+
+    if(response.code != 0) {
+        server.code = response.code;
+    } else if(ranged && server.ranges && (server.ifRange[0] == '\0' || strcmp(server.ifRange, server.etag) == 0)) {
+        server.code = 206;
+        server.start = start;
+    } else {
+        server.code = 200;
+    }
+
+    server.dropAfter = response.dropAfter;
+    return 0;
+}
+
+Result httpcGetResponseStatusCode(httpcContext* context, u32* out, u64 delay) {
+    (void) context;
+    (void) delay;
+
+    *out = server.code;
+    return 0;
+}
+
+Result httpcGetResponseHeader(httpcContext* context, const char* name, char* value, u32 valuebuf_maxsize) {
+    (void) context;
+
+    const char* header = NULL;
+    if(strcmp(name, "Accept-Ranges") == 0 && server.ranges) {
+        header = "bytes";
+    } else if(strcmp(name, "ETag") == 0 && server.etag[0] != '\0') {
+        header = server.etag;
+    }
+
+    if(header == NULL) {
+        return R_TEST_DROPPED;
+    }
+
+    snprintf(value, valuebuf_maxsize, "%s", header);
+    return 0;
+}
+
+Result httpcGetDownloadSizeState(httpcContext* context, u32* downloadedsize, u32* contentsize) {
+    (void) context;
+
+    if(downloadedsize != NULL) {
+        *downloadedsize = (u32) server.served;
+    }
+
+    if(contentsize != NULL) {
+        *contentsize = (u32) (BODY_SIZE - server.start);
+    }
+
+    return 0;
+}
+
+Result httpcDownloadData(httpcContext* context, u8* buffer, u32 size, u32* downloadedsize) {
+    (void) context;
+
+    u64 remaining = BODY_SIZE - server.start - server.served;
+
+    u64 n = size < remaining ? size : remaining;
+    if(server.dropAfter != 0 && server.served + n > server.dropAfter) {
+        n = server.dropAfter - server.served;
+    }
+
+    memcpy(buffer, server.body + server.start + server.served, n);
+    server.served += n;
+    *downloadedsize = (u32) n;
+
+    if(server.dropAfter != 0 && server.served >= server.dropAfter) {
+        return R_TEST_DROPPED;
+    }
+
+    return n == remaining ? 0 : HTTPC_RESULTCODE_DOWNLOADPENDING;
+}
+
+// Resets the server to serve the body with ranges and an ETag, answering
+// each request in turn from script.
+static void test_begin(const char* name, const test_response* script, u32 scriptCount) {
+    currentTest = name;
+
+    server.ranges = true;
+    snprintf(server.etag, sizeof(server.etag), "%s", ETAG);
+
+    memcpy(server.script, script, scriptCount * sizeof(test_response));
+    server.scriptCount = scriptCount;
+    server.requests = 0;
+
+    server.sleepCount = 0;
+}
+
+// Reads the way the CDN download loop does, until the stream ends or fails.
+static Result test_fetch(http_stream* stream, u8* out) {
+    Result res = 0;
+
+    u64 offset = 0;
+    for(u32 reads = 0; offset < stream->size && reads < 1000; reads++) {
+        u64 remaining = stream->size - offset;
+
+        u32 bytesRead = 0;
+        if(R_FAILED(res = http_stream_read(stream, &bytesRead, out + offset, remaining < READ_SIZE ? (u32) remaining : READ_SIZE))) {
+            break;
+        }
+
+        offset += bytesRead;
+    }
+
+    return res;
+}
+
+static Result test_run(http_stream* stream, u8* out, const char* newEtag) {
+    Result res = http_stream_open(stream, "http://example.invalid/content");
+    CHECK(R_SUCCEEDED(res));
+
+    if(R_SUCCEEDED(res)) {
+        CHECK(stream->size == BODY_SIZE);
+        CHECK(stream->ranges);
+        CHECK(strcmp(stream->etag, ETAG) == 0);
+
+        // The resource changes once the first connection is under way.
+        if(newEtag != NULL) {
+            snprintf(server.etag, sizeof(server.etag), "%s", newEtag);
+        }
+
+        res = test_fetch(stream, out);
+    }
+
+    http_stream_close(stream);
+    return res;
+}
+
+// A dropped connection resumes at the last byte read, on the same version.
+static void test_resume() {
+    test_response script[] = {{0, DROP_OFFSET}, {0, 0}};
+    test_begin("resume", script, 2);
+
+    static u8 out[BODY_SIZE];
+    memset(out, 0, sizeof(out));
+
+    http_stream stream;
+    CHECK(R_SUCCEEDED(test_run(&stream, out, NULL)));
+
+    char range[32];
+    snprintf(range, sizeof(range), "bytes=%u-", DROP_OFFSET);
+
+    CHECK(server.requests == 2);
+    CHECK(strcmp(server.range, range) == 0);
+    CHECK(strcmp(server.ifRange, ETAG) == 0);
+    CHECK(stream.responseCode == 206);
+    CHECK(stream.retries == 0);
+    CHECK(server.sleepCount == 1 && server.sleeps[0] == 500000000);
+    CHECK(memcmp(out, server.body, BODY_SIZE) == 0);
+}
+
+// Failed reconnects back off a little more each time, then resume.
+static void test_backoff() {
+    test_response script[] = {{0, DROP_OFFSET}, {503, 0}, {503, 0}, {0, 0}};
+    test_begin("backoff", script, 4);
+
+    static u8 out[BODY_SIZE];
+    memset(out, 0, sizeof(out));
+
+    http_stream stream;
+    CHECK(R_SUCCEEDED(test_run(&stream, out, NULL)));
+
+    CHECK(server.requests == 4);
+    CHECK(server.sleepCount == 3);
+    CHECK(server.sleeps[0] == 500000000 && server.sleeps[1] == 1000000000 && server.sleeps[2] == 1500000000);
+    CHECK(memcmp(out, server.body, BODY_SIZE) == 0);
+}
+
+// A server that keeps failing is given HTTP_RETRIES_MAX reconnects.
+static void test_retries_exhausted() {
+    test_response script[] = {{0, DROP_OFFSET}, {503, 0}, {503, 0}, {503, 0}, {503, 0}, {503, 0}};
+    test_begin("retries exhausted", script, 6);
+
+    static u8 out[BODY_SIZE];
+
+    http_stream stream;
+    CHECK(test_run(&stream, out, NULL) == R_FBI_HTTP_RESPONSE_CODE);
+
+    CHECK(server.requests == 1 + HTTP_RETRIES_MAX);
+    CHECK(server.sleepCount == HTTP_RETRIES_MAX);
+    for(u32 i = 0; i < HTTP_RETRIES_MAX && i < server.sleepCount; i++) {
+        CHECK(server.sleeps[i] == 500000000LL * (i + 1));
+    }
+}
+
+// A resumed request must be answered with 206; a 200 means the server
+// ignored the range and fails without further retries.
+static void test_requires_206() {
+    test_response script[] = {{0, DROP_OFFSET}, {200, 0}, {0, 0}};
+    test_begin("requires 206", script, 3);
+
+    static u8 out[BODY_SIZE];
+
+    http_stream stream;
+    CHECK(test_run(&stream, out, NULL) == R_FBI_HTTP_RESPONSE_CODE);
+
+    CHECK(stream.responseCode == 200);
+    CHECK(server.requests == 2);
+    CHECK(server.sleepCount == 1);
+}
+
+// If-Range sends back the full new version when the ETag changed; that fails
+// at once rather than after every retry.
+static void test_etag_mismatch() {
+    test_response script[] = {{0, DROP_OFFSET}};
+    test_begin("etag mismatch", script, 1);
+
+    static u8 out[BODY_SIZE];
+
+    http_stream stream;
+    CHECK(test_run(&stream, out, "\"v2\"") == R_FBI_HTTP_RESPONSE_CODE);
+
+    CHECK(strcmp(server.ifRange, ETAG) == 0);
+    CHECK(stream.responseCode == 200);
+    CHECK(server.requests == 2);
+    CHECK(server.sleepCount == 1);
+}
+
+// Without Accept-Ranges, a dropped connection is not resumed.
+static void test_no_ranges() {
+    test_response script[] = {{0, DROP_OFFSET}};
+    test_begin("no ranges", script, 1);
+    server.ranges = false;
+
+    static u8 out[BODY_SIZE];
+
+    http_stream stream;
+    Result res = http_stream_open(&stream, "http://example.invalid/content");
+    CHECK(R_SUCCEEDED(res));
+    CHECK(!stream.ranges);
+
+    if(R_SUCCEEDED(res)) {
+        CHECK(test_fetch(&stream, out) == R_TEST_DROPPED);
+    }
+
+    http_stream_close(&stream);
+
+    CHECK(server.requests == 1);
+    CHECK(server.sleepCount == 0);
+}
+
+int main() {
+    for(u32 i = 0; i < BODY_SIZE; i++) {
+        server.body[i] = (u8) (i * 31 + (i >> 8));
+    }
+
+    void (*tests[])() = {test_resume, test_backoff, test_retries_exhausted, test_requires_206, test_etag_mismatch, test_no_ranges};
+    for(u32 i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        u32 before = failures;
+        tests[i]();
+        printf("%s %s\n", failures == before ? "ok  " : "FAIL", currentTest);
+    }
+
+    return failures != 0 ? 1 : 0;
+}
@@ -0,0 +1,635 @@
+// Host check of the QR recognizer in source/quirc/, on synthetic camera
+// frames: RGB565 images with lighting gradients, noise, dark blobs and
+// QR-like codes (finder, timing and alignment patterns around random data).
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <3ds.h>
+
+#include "../../source/quirc/quirc_internal.h"
+
+#define FRAME_WIDTH 400
+#define FRAME_HEIGHT 240
+
+#define FILL_FRAMES 40
+#define RUN_SIZES 200
+
+#define ROI_PAIRS 240
+#define ROI_MOVE 40
+
+#define CODE_MAX 25
+#define QUIET_ZONE 4
+
+static const char* currentTest = NULL;
+static u32 failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if(!(cond)) { \
+            fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, currentTest, #cond); \
+            failures++; \
+        } \
+    } while(0)
+
+// identify.c is built with realloc() pointed here, so fill stack growth can
+// be made to fail.
+static bool reallocFails = false;
+
+void* quirctest_realloc(void* ptr, size_t size) {
+    return reallocFails ? NULL : realloc(ptr, size);
+}
+
+static u32 rngState = 0x51524331;
+
+static u32 test_rand() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+static int test_rand_range(int min, int max) {
+    return min + (int) (test_rand() % (u32) (max - min + 1));
+}
+
+// A QR-like code of size modules drawn with its top left module at (x, y),
+// turned by angle radians about its centre.
+typedef struct {
+    int size;
+    u8 modules[CODE_MAX][CODE_MAX];
+
+    double x;
+    double y;
+    double moduleSize;
+    double angle;
+} test_code;
+
+static void test_code_finder(test_code* code, int left, int top) {
+    for(int y = 0; y < 7; y++) {
+        for(int x = 0; x < 7; x++) {
+            bool ring = x == 0 || y == 0 || x == 6 || y == 6;
+            bool stone = x >= 2 && x <= 4 && y >= 2 && y <= 4;
+            code->modules[top + y][left + x] = ring || stone;
+        }
+    }
+}
+
+// Version 1 or 2; data modules are random, so codes are located and
+// sampled but not decoded.
+static void test_code_make(test_code* code, int version) {
+    code->size = 17 + version * 4;
+
+    for(int y = 0; y < code->size; y++) {
+        for(int x = 0; x < code->size; x++) {
+            code->modules[y][x] = test_rand() & 1;
+        }
+    }
+
+    // Separators
+    for(int i = 0; i < 8; i++) {
+        code->modules[7][i] = code->modules[i][7] = 0;
+        code->modules[7][code->size - 1 - i] = code->modules[i][code->size - 8] = 0;
+        code->modules[code->size - 8][i] = code->modules[code->size - 1 - i][7] = 0;
+    }
+
+    test_code_finder(code, 0, 0);
+    test_code_finder(code, code->size - 7, 0);
+    test_code_finder(code, 0, code->size - 7);
+
+    for(int i = 8; i < code->size - 8; i++) {
+        code->modules[6][i] = code->modules[i][6] = !(i & 1);
+    }
+
+    if(version >= 2) {
+        int centre = code->size - 7;
+        for(int y = -2; y <= 2; y++) {
+            for(int x = -2; x <= 2; x++) {
+                code->modules[centre + y][centre + x] = abs(x) == 2 || abs(y) == 2 || (x == 0 && y == 0);
+            }
+        }
+    }
+}
+
+// Whether (px, py) falls on a dark module, or -1 outside the code and its
+// quiet zone.
+static int test_code_sample(const test_code* code, double px, double py) {
+    double half = code->size * code->moduleSize / 2;
+    double cx = code->x + half;
+    double cy = code->y + half;
+
+    double c = cos(-code->angle);
+    double s = sin(-code->angle);
+    double u = ((px - cx) * c - (py - cy) * s + half) / code->moduleSize;
+    double v = ((px - cx) * s + (py - cy) * c + half) / code->moduleSize;
+
+    if(u < -QUIET_ZONE || v < -QUIET_ZONE || u >= code->size + QUIET_ZONE || v >= code->size + QUIET_ZONE) {
+        return -1;
+    }
+
+    if(u < 0 || v < 0 || u >= code->size || v >= code->size) {
+        return 0;
+    }
+
+    return code->modules[(int) v][(int) u];
+}
+
+static u16 test_rgb565(int gray, int tint) {
+    int r = gray + tint;
+    int g = gray;
+    int b = gray - tint;
+
+    r = r < 0 ? 0 : r > 255 ? 255 : r;
+    g = g < 0 ? 0 : g > 255 ? 255 : g;
+    b = b < 0 ? 0 : b > 255 ? 255 : b;
+
+    return (u16) (((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+}
+
+// Lit from one side, with a few dark blobs and per-pixel noise; code may be
+// NULL.
+static void test_frame_make(u16* pixels, int w, int h, int stride, const test_code* code) {
+    int base = test_rand_range(120, 200);
+    int slope = test_rand_range(-60, 60);
+    int tint = test_rand_range(-20, 20);
+
+    int blobs = test_rand_range(0, 6);
+    int blobX[6], blobY[6], blobR[6];
+    for(int i = 0; i < blobs; i++) {
+        blobX[i] = test_rand_range(0, w - 1);
+        blobY[i] = test_rand_range(0, h - 1);
+        blobR[i] = test_rand_range(2, w / 8 + 2);
+    }
+
+    for(int y = 0; y < h; y++) {
+        for(int x = 0; x < stride; x++) {
+            int light = base + slope * x / w;
+            int gray = light;
+
+            for(int i = 0; i < blobs; i++) {
+                int dx = x - blobX[i];
+                int dy = y - blobY[i];
+                if(dx * dx + dy * dy < blobR[i] * blobR[i]) {
+                    gray = light / 3;
+                }
+            }
+
+            if(code != NULL) {
+                int module = test_code_sample(code, x + 0.5, y + 0.5);
+                if(module >= 0) {
+                    gray = module ? light / 5 : light + 30;
+                }
+            }
+
+            gray += test_rand_range(-12, 12);
+
+            pixels[y * stride + x] = test_rgb565(gray, tint);
+        }
+    }
+}
+
+static void test_code_place(test_code* code, int w, int h) {
+    test_code_make(code, test_rand_range(1, 2));
+
+    code->moduleSize = test_rand_range(20, 45) / 10.0;
+    code->angle = test_rand_range(-12, 12) * M_PI / 180;
+
+    double extent = (code->size + QUIET_ZONE * 2) * code->moduleSize * 1.2;
+    code->x = test_rand_range(0, (int) (w - extent)) + QUIET_ZONE * code->moduleSize;
+    code->y = test_rand_range(0, (int) (h - extent)) + QUIET_ZONE * code->moduleSize;
+}
+
+// The conversion and threshold quirc_load_rgb565() replaced: a column-major
+// gray conversion in QR install, and a threshold with a per-row average.
+static void test_reference_threshold(const u16* pixels, int w, int h, int stride, u8* image) {
+    for(int x = 0; x < w; x++) {
+        for(int y = 0; y < h; y++) {
+            u16 px = pixels[y * stride + x];
+            image[y * w + x] = (u8) (((((px >> 11) & 0x1F) << 3) + (((px >> 5) & 0x3F) << 2) + ((px & 0x1F) << 3)) / 3);
+        }
+    }
+
+    int avgW = 0;
+    int avgU = 0;
+    int s = w / 8;
+    u8* row = image;
+
+    int* rowAverage = (int*) malloc(w * sizeof(int));
+
+    for(int y = 0; y < h; y++) {
+        memset(rowAverage, 0, w * sizeof(int));
+
+        for(int x = 0; x < w; x++) {
+            int wx = (y & 1) ? x : w - 1 - x;
+            int ux = (y & 1) ? w - 1 - x : x;
+
+            avgW = (avgW * (s - 1)) / s + row[wx];
+            avgU = (avgU * (s - 1)) / s + row[ux];
+
+            rowAverage[wx] += avgW;
+            rowAverage[ux] += avgU;
+        }
+
+        for(int x = 0; x < w; x++) {
+            row[x] = row[x] < rowAverage[x] * (100 - 5) / (200 * s) ? QUIRC_PIXEL_BLACK : QUIRC_PIXEL_WHITE;
+        }
+
+        row += w;
+    }
+
+    free(rowAverage);
+}
+
+static void test_threshold() {
+    currentTest = "threshold";
+
+    // Widths of at least 8, where the per-row average of the old code has a
+    // non-zero window; odd strides put every other row out of word alignment.
+    static const int sizes[][3] = {{400, 240, 400}, {400, 240, 403}, {321, 199, 321}, {64, 48, 67}, {17, 9, 17}, {8, 8, 8}, {2040, 12, 2041}};
+
+    for(u32 i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        int w = sizes[i][0];
+        int h = sizes[i][1];
+        int stride = sizes[i][2];
+
+        u16* pixels = (u16*) malloc(stride * h * sizeof(u16));
+        u8* expected = (u8*) malloc(w * h);
+        struct quirc* q = quirc_new();
+
+        CHECK(pixels != NULL && expected != NULL && q != NULL && quirc_resize(q, w, h) == 0);
+
+        for(int frame = 0; frame < 8; frame++) {
+            test_code code;
+            bool withCode = w >= 64 && h >= 48 && (frame & 1);
+            if(withCode) {
+                test_code_place(&code, w, h);
+            }
+
+            test_frame_make(pixels, w, h, stride, withCode ? &code : NULL);
+            test_reference_threshold(pixels, w, h, stride, expected);
+
+            quirc_load_rgb565(q, pixels, stride);
+            CHECK(memcmp(q->image, expected, w * h) == 0);
+
+            // The gray path, thresholded by quirc_end(); regions are
+            // labelled by then, so only compare black against white.
+            int gw = 0;
+            int gh = 0;
+            u8* gray = quirc_begin(q, &gw, &gh);
+            for(int y = 0; y < h; y++) {
+                for(int x = 0; x < w; x++) {
+                    u16 px = pixels[y * stride + x];
+                    gray[y * w + x] = (u8) (((((px >> 11) & 0x1F) << 3) + (((px >> 5) & 0x3F) << 2) + ((px & 0x1F) << 3)) / 3);
+                }
+            }
+
+            quirc_end(q);
+
+            bool same = true;
+            for(int p = 0; p < w * h; p++) {
+                if((q->image[p] != QUIRC_PIXEL_WHITE) != (expected[p] == QUIRC_PIXEL_BLACK)) {
+                    same = false;
+                }
+            }
+
+            CHECK(same);
+        }
+
+        quirc_destroy(q);
+        free(expected);
+        free(pixels);
+    }
+}
+
+// What a search left behind, for comparing two runs over the same frame.
+typedef struct {
+    u8* image;
+
+    int numRegions;
+    struct quirc_region regions[QUIRC_MAX_REGIONS];
+
+    int numCapstones;
+    struct quirc_capstone capstones[QUIRC_MAX_CAPSTONES];
+
+    int numGrids;
+    struct quirc_code codes[QUIRC_MAX_GRIDS];
+
+    bool found;
+    struct quirc_point min;
+    struct quirc_point max;
+} test_result;
+
+// Runs a search over a frame, limited to roi (x, y, w, h) if not NULL, with
+// a fill stack of stackSize entries if non-zero, and growth failing if asked
+// to.
+static void test_search(const u16* pixels, int w, int h, const int* roi, int stackSize, bool growthFails, test_result* result) {
+    struct quirc* q = quirc_new();
+    CHECK(q != NULL && quirc_resize(q, w, h) == 0);
+
+    if(roi != NULL) {
+        quirc_set_roi(q, roi[0], roi[1], roi[2], roi[3]);
+    }
+
+    if(stackSize != 0) {
+        q->fill_stack_size = stackSize;
+    }
+
+    quirc_load_rgb565(q, pixels, w);
+
+    reallocFails = growthFails;
+    quirc_end(q);
+    reallocFails = false;
+
+    result->image = (u8*) malloc(w * h);
+    memcpy(result->image, q->image, w * h);
+
+    result->numRegions = q->num_regions;
+    memcpy(result->regions, q->regions, sizeof(q->regions));
+
+    result->numCapstones = q->num_capstones;
+    memcpy(result->capstones, q->capstones, sizeof(q->capstones));
+
+    result->found = quirc_find_bounds(q, &result->min, &result->max);
+
+    result->numGrids = quirc_count(q);
+    memset(result->codes, 0, sizeof(result->codes));
+    for(int i = 0; i < result->numGrids; i++) {
+        quirc_extract(q, i, &result->codes[i]);
+    }
+
+    quirc_destroy(q);
+}
+
+static bool test_same_capstones(const test_result* a, const test_result* b) {
+    if(a->numCapstones != b->numCapstones) {
+        return false;
+    }
+
+    for(int i = 0; i < a->numCapstones; i++) {
+        const struct quirc_capstone* ca = &a->capstones[i];
+        const struct quirc_capstone* cb = &b->capstones[i];
+
+        if(ca->ring != cb->ring || ca->stone != cb->stone || ca->qr_grid != cb->qr_grid
+           || memcmp(ca->corners, cb->corners, sizeof(ca->corners)) != 0 || memcmp(&ca->center, &cb->center, sizeof(ca->center)) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool test_same_codes(const test_result* a, const test_result* b) {
+    return a->numGrids == b->numGrids && memcmp(a->codes, b->codes, a->numGrids * sizeof(struct quirc_code)) == 0;
+}
+
+// Whether every labelled region is exactly the 4-connected black component
+// of the reference threshold holding its seed, with the pixel count
+// recorded for it.
+static bool test_regions_match(const test_result* result, const u8* binary, int w, int h) {
+    int* queue = (int*) malloc(w * h * sizeof(int));
+    u8* seen = (u8*) malloc(w * h);
+
+    bool match = true;
+
+    for(int r = QUIRC_PIXEL_REGION; r < result->numRegions && match; r++) {
+        const struct quirc_region* region = &result->regions[r];
+
+        memset(seen, 0, w * h);
+
+        int head = 0;
+        int tail = 0;
+        int start = region->seed.y * w + region->seed.x;
+        queue[tail++] = start;
+        seen[start] = 1;
+
+        while(head < tail) {
+            int p = queue[head++];
+            int x = p % w;
+            int y = p / w;
+
+            if(result->image[p] != r) {
+                match = false;
+            }
+
+            int neighbours[4] = {x > 0 ? p - 1 : -1, x < w - 1 ? p + 1 : -1, y > 0 ? p - w : -1, y < h - 1 ? p + w : -1};
+            for(int i = 0; i < 4; i++) {
+                int n = neighbours[i];
+                if(n >= 0 && !seen[n] && binary[n] == QUIRC_PIXEL_BLACK) {
+                    seen[n] = 1;
+                    queue[tail++] = n;
+                }
+            }
+        }
+
+        int labelled = 0;
+        for(int p = 0; p < w * h; p++) {
+            if(result->image[p] == r) {
+                labelled++;
+            }
+        }
+
+        if(tail != region->count || labelled != region->count) {
+            match = false;
+        }
+    }
+
+    free(seen);
+    free(queue);
+
+    return match;
+}
+
+static void test_regions() {
+    currentTest = "regions";
+
+    u16* pixels = (u16*) malloc(FRAME_WIDTH * FRAME_HEIGHT * sizeof(u16));
+    u8* binary = (u8*) malloc(FRAME_WIDTH * FRAME_HEIGHT);
+
+    int grids = 0;
+
+    for(int frame = 0; frame < FILL_FRAMES; frame++) {
+        test_code code;
+        test_code_place(&code, FRAME_WIDTH, FRAME_HEIGHT);
+
+        test_frame_make(pixels, FRAME_WIDTH, FRAME_HEIGHT, FRAME_WIDTH, &code);
+        test_reference_threshold(pixels, FRAME_WIDTH, FRAME_HEIGHT, FRAME_WIDTH, binary);
+
+        test_result full;
+        test_search(pixels, FRAME_WIDTH, FRAME_HEIGHT, NULL, 0, false, &full);
+
+        CHECK(test_regions_match(&full, binary, FRAME_WIDTH, FRAME_HEIGHT));
+        grids += full.numGrids;
+
+        // A three-entry stack that can or cannot grow; dropped seeds are
+        // picked up by rescanning, so the outcome must not change.
+        for(int growthFails = 0; growthFails < 2; growthFails++) {
+            test_result small;
+            test_search(pixels, FRAME_WIDTH, FRAME_HEIGHT, NULL, 3, growthFails, &small);
+
+            CHECK(small.numRegions == full.numRegions);
+            CHECK(memcmp(small.regions, full.regions, full.numRegions * sizeof(struct quirc_region)) == 0);
+            CHECK(memcmp(small.image, full.image, FRAME_WIDTH * FRAME_HEIGHT) == 0);
+            CHECK(test_same_capstones(&small, &full));
+            CHECK(test_same_codes(&small, &full));
+
+            free(small.image);
+        }
+
+        free(full.image);
+    }
+
+    // Codes must actually be found for the above to mean anything.
+    CHECK(grids >= FILL_FRAMES / 2);
+
+    free(binary);
+    free(pixels);
+}
+
+// Runs alternate white and black starting with white, each given as the x
+// just past its end; only the first may be empty, and the last ends at w.
+static bool test_runs_match(const struct quirc* q) {
+    for(int y = 0; y < q->h; y++) {
+        const u8* row = q->image + y * q->w;
+        int start = q->run_start[y];
+        const u16* runs = q->runs + y * (q->w + 1) + start;
+        int n = q->w + 1 - start;
+
+        if(n < 1 || runs[n - 1] != q->w) {
+            return false;
+        }
+
+        int x = 0;
+        for(int k = 0; k < n; k++) {
+            if(runs[k] < x || (k > 0 && runs[k] == x)) {
+                return false;
+            }
+
+            for(; x < runs[k]; x++) {
+                if(row[x] != ((k & 1) ? QUIRC_PIXEL_BLACK : QUIRC_PIXEL_WHITE)) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+static void test_runs() {
+    currentTest = "runs";
+
+    for(int i = 0; i < RUN_SIZES; i++) {
+        int w = test_rand_range(8, 640);
+        int h = test_rand_range(1, 64);
+
+        u16* pixels = (u16*) malloc(w * h * sizeof(u16));
+        struct quirc* q = quirc_new();
+
+        CHECK(pixels != NULL && q != NULL && quirc_resize(q, w, h) == 0);
+
+        test_code code;
+        bool withCode = w >= 160 && h >= 48 && (i & 1);
+        if(withCode) {
+            test_code_place(&code, w, h);
+        }
+
+        test_frame_make(pixels, w, h, w, withCode ? &code : NULL);
+
+        // Rows and columns outside a region of interest are left white.
+        if(i % 3 == 2) {
+            quirc_set_roi(q, test_rand_range(-8, w - 1), test_rand_range(-8, h - 1), test_rand_range(1, w), test_rand_range(1, h));
+        }
+
+        quirc_load_rgb565(q, pixels, w);
+        CHECK(test_runs_match(q));
+
+        quirc_destroy(q);
+        free(pixels);
+    }
+}
+
+// Pairs of frames with a code that moves from the first to the second, as in
+// front of a handheld camera. The second is searched in full and around the
+// first's bounds, padded by their size as QR install does. A code wholly
+// inside the hint must come out the same; one cut by its edge may be missed
+// or sampled differently, which the periodic full search makes up for.
+static void test_roi() {
+    currentTest = "roi";
+
+    u16* pixels = (u16*) malloc(FRAME_WIDTH * FRAME_HEIGHT * sizeof(u16));
+
+    int pairs = 0;
+    int matched = 0;
+    int cut = 0;
+
+    for(int i = 0; i < ROI_PAIRS; i++) {
+        test_code code;
+        test_code_place(&code, FRAME_WIDTH, FRAME_HEIGHT);
+
+        test_frame_make(pixels, FRAME_WIDTH, FRAME_HEIGHT, FRAME_WIDTH, &code);
+
+        test_result first;
+        test_search(pixels, FRAME_WIDTH, FRAME_HEIGHT, NULL, 0, false, &first);
+        free(first.image);
+
+        if(!first.found) {
+            continue;
+        }
+
+        code.x += test_rand_range(-ROI_MOVE, ROI_MOVE);
+        code.y += test_rand_range(-ROI_MOVE, ROI_MOVE);
+        test_frame_make(pixels, FRAME_WIDTH, FRAME_HEIGHT, FRAME_WIDTH, &code);
+
+        int padX = first.max.x - first.min.x;
+        int padY = first.max.y - first.min.y;
+        int roi[4] = {first.min.x - padX, first.min.y - padY, first.max.x - first.min.x + 1 + padX * 2, first.max.y - first.min.y + 1 + padY * 2};
+
+        test_result full;
+        test_search(pixels, FRAME_WIDTH, FRAME_HEIGHT, NULL, 0, false, &full);
+        free(full.image);
+
+        test_result hinted;
+        test_search(pixels, FRAME_WIDTH, FRAME_HEIGHT, roi, 0, false, &hinted);
+        free(hinted.image);
+
+        if(full.numGrids == 0) {
+            continue;
+        }
+
+        pairs++;
+
+        int x0 = roi[0] > 0 ? roi[0] : 0;
+        int y0 = roi[1] > 0 ? roi[1] : 0;
+        int x1 = roi[0] + roi[2] < FRAME_WIDTH ? roi[0] + roi[2] : FRAME_WIDTH;
+        int y1 = roi[1] + roi[3] < FRAME_HEIGHT ? roi[1] + roi[3] : FRAME_HEIGHT;
+
+        if(full.min.x >= x0 && full.min.y >= y0 && full.max.x < x1 && full.max.y < y1) {
+            CHECK(test_same_codes(&hinted, &full));
+        } else {
+            cut++;
+        }
+
+        if(test_same_codes(&hinted, &full)) {
+            matched++;
+        }
+    }
+
+    printf("     roi: %d of %d frames found the same codes as the full search; %d codes were cut by the hint\n", matched, pairs, cut);
+
+    CHECK(pairs >= ROI_PAIRS / 2);
+
+    free(pixels);
+}
+
+int main() {
+    void (*tests[])() = {test_threshold, test_regions, test_runs, test_roi};
+    for(u32 i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        u32 before = failures;
+        tests[i]();
+        printf("%s %s\n", failures == before ? "ok  " : "FAIL", currentTest);
+    }
+
+    return failures != 0 ? 1 : 0;
+}
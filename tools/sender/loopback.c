@@ -0,0 +1,507 @@
+// Loopback harness: runs FBI's network install receiver
+// (source/ui/section/networkinstall.c and the data op engine) on the host,
+// against a stand-in AM that only counts bytes, and feeds it generated files
+// through the sender. Delays injected into the AM calls model the console's
+// install cost, to see how the protocol window and compression hide it.
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <3ds.h>
+
+#include "sender.h"
+#include "../host/host.h"
+#include "../../source/core/util.h"
+#include "../../source/ui/info.h"
+#include "../../source/ui/prompt.h"
+#include "../../source/ui/ui.h"
+#include "../../source/ui/section/section.h"
+#include "../../source/ui/section/task/task.h"
+#include "../../source/ui/section/action/action.h"
+
+#define LOOPBACK_PORT 5000
+#define LOOPBACK_VIEWS_MAX 8
+#define LOOPBACK_FRAME_NS 16666667
+#define LOOPBACK_HEAP (16 * 1024 * 1024)
+
+#define CIA_HEADER_SIZE 0x20
+
+#define MIB (1024.0 * 1024.0)
+
+typedef struct {
+    ui_view view;
+
+    void (*update)(ui_view* view, void* data, float* progress, char* text);
+} loopback_view;
+
+// Install cost of the stand-in AM.
+typedef struct {
+    u64 beginNs;
+    u64 finishNs;
+    u64 writeNs;
+    u64 bytesPerSec;
+} loopback_sink;
+
+typedef struct {
+    u32 count;
+    u64 size;
+    bool random;
+
+    u32 version;
+    u32 flags;
+
+    bool verbose;
+
+    // Results
+    volatile bool done;
+    bool succeeded;
+    double elapsed;
+
+    double* latencies;
+    u32 acked;
+} loopback_send;
+
+static loopback_view* views[LOOPBACK_VIEWS_MAX];
+static u32 viewCount = 0;
+
+static loopback_sink sink;
+static pthread_mutex_t sinkLock = PTHREAD_MUTEX_INITIALIZER;
+static Handle nextInstall = 0x1000;
+static u64 installed = 0;
+static u32 installCount = 0;
+
+static volatile u32 keysDown = 0;
+static volatile bool failed = false;
+
+static void loopback_delay(u64 fixedNs, u32 size) {
+    u64 ns = fixedNs;
+    if(sink.bytesPerSec != 0) {
+        ns += size * 1000000000ULL / sink.bytesPerSec;
+    }
+
+    if(ns != 0) {
+        svcSleepThread((s64) ns);
+    }
+}
+
+// UI; views are updated once per frame from the main loop and prompts are
+// answered yes as soon as they are shown.
+
+void info_display(const char* name, const char* info, bool bar, void* data, void (*update)(ui_view* view, void* data, float* progress, char* text),
+                  void (*drawTop)(ui_view* view, void* data, float x1, float y1, float x2, float y2)) {
+    (void) bar;
+    (void) drawTop;
+
+    loopback_view* view = (loopback_view*) calloc(1, sizeof(loopback_view));
+    if(view == NULL || viewCount == LOOPBACK_VIEWS_MAX) {
+        fprintf(stderr, "Too many views.\n");
+        exit(1);
+    }
+
+    view->view.name = name;
+    view->view.info = info;
+    view->view.data = data;
+    view->update = update;
+
+    views[viewCount++] = view;
+}
+
+void info_destroy(ui_view* view) {
+    free(view);
+}
+
+void ui_pop() {
+    if(viewCount > 0) {
+        viewCount--;
+    }
+}
+
+void prompt_display(const char* name, const char* text, u32 rgba, bool option, void* data, void (*update)(ui_view* view, void* data),
+                    void (*drawTop)(ui_view* view, void* data, float x1, float y1, float x2, float y2),
+                    void (*onResponse)(ui_view* view, void* data, bool response)) {
+    (void) rgba;
+    (void) option;
+    (void) update;
+    (void) drawTop;
+
+    if(strcmp(name, "Success") != 0) {
+        printf("%s: %s\n", name, text);
+    }
+
+    if(onResponse != NULL) {
+        onResponse(NULL, data, true);
+    }
+}
+
+static void loopback_error(const char* text, const char* detail) {
+    fprintf(stderr, "Error: %s (%s)\n", text, detail);
+    failed = true;
+}
+
+void error_display(volatile bool* dismissed, void* data, void (*drawTop)(ui_view* view, void* data, float x1, float y1, float x2, float y2), const char* text, ...) {
+    (void) data;
+    (void) drawTop;
+
+    loopback_error(text, "-");
+
+    if(dismissed != NULL) {
+        *dismissed = true;
+    }
+}
+
+void error_display_res(volatile bool* dismissed, void* data, void (*drawTop)(ui_view* view, void* data, float x1, float y1, float x2, float y2), Result result, const char* text, ...) {
+    (void) data;
+    (void) drawTop;
+
+    char detail[16];
+    snprintf(detail, sizeof(detail), "0x%08X", (unsigned int) result);
+    loopback_error(text, detail);
+
+    if(dismissed != NULL) {
+        *dismissed = true;
+    }
+}
+
+void error_display_errno(volatile bool* dismissed, void* data, void (*drawTop)(ui_view* view, void* data, float x1, float y1, float x2, float y2), int err, const char* text, ...) {
+    (void) data;
+    (void) drawTop;
+
+    loopback_error(text, strerror(err));
+
+    if(dismissed != NULL) {
+        *dismissed = true;
+    }
+}
+
+u32 hidKeysDown(void) {
+    return keysDown;
+}
+
+// AM; installs only count the bytes written to them.
+
+Result AM_StartCiaInstall(FS_MediaType mediaType, Handle* ciaHandle) {
+    (void) mediaType;
+
+    loopback_delay(sink.beginNs, 0);
+
+    pthread_mutex_lock(&sinkLock);
+    *ciaHandle = nextInstall++;
+    pthread_mutex_unlock(&sinkLock);
+
+    return 0;
+}
+
+Result AM_FinishCiaInstall(Handle ciaHandle) {
+    (void) ciaHandle;
+
+    loopback_delay(sink.finishNs, 0);
+
+    pthread_mutex_lock(&sinkLock);
+    installCount++;
+    pthread_mutex_unlock(&sinkLock);
+
+    return 0;
+}
+
+Result AM_CancelCIAInstall(Handle ciaHandle) {
+    (void) ciaHandle;
+
+    return 0;
+}
+
+Result AM_InstallTicketBegin(Handle* ticketHandle) {
+    return AM_StartCiaInstall(MEDIATYPE_NAND, ticketHandle);
+}
+
+Result AM_InstallTicketFinish(Handle ticketHandle) {
+    return AM_FinishCiaInstall(ticketHandle);
+}
+
+Result AM_InstallTicketAbort(Handle ticketHandle) {
+    return AM_CancelCIAInstall(ticketHandle);
+}
+
+Result AM_DeleteTitle(FS_MediaType mediaType, u64 titleId) {
+    (void) mediaType;
+    (void) titleId;
+
+    return 0;
+}
+
+Result AM_DeleteTicket(u64 ticketId) {
+    (void) ticketId;
+
+    return 0;
+}
+
+Result AM_QueryAvailableExternalTitleDatabase(bool* available) {
+    if(available != NULL) {
+        *available = true;
+    }
+
+    return 0;
+}
+
+Result AM_InstallFirm(u64 titleId) {
+    (void) titleId;
+
+    return 0;
+}
+
+static Result loopback_write(Handle handle, u32* bytesWritten, u64 offset, const void* buffer, u32 size) {
+    (void) handle;
+    (void) offset;
+    (void) buffer;
+
+    loopback_delay(sink.writeNs, size);
+
+    pthread_mutex_lock(&sinkLock);
+    installed += size;
+    pthread_mutex_unlock(&sinkLock);
+
+    *bytesWritten = size;
+    return 0;
+}
+
+static Result loopback_close(Handle handle) {
+    (void) handle;
+
+    return 0;
+}
+
+// Helpers networkinstall.c links against.
+
+u64 util_get_cia_title_id(u8* cia) {
+    (void) cia;
+
+    return 0x0004000000100000ULL;
+}
+
+u64 util_get_ticket_title_id(u8* ticket) {
+    (void) ticket;
+
+    return 0x0004000000100000ULL;
+}
+
+Result util_import_seed(u64 titleId) {
+    (void) titleId;
+
+    return 0;
+}
+
+void action_install_cdn_noprompt(volatile bool* done, ticket_info* info, bool finishedPrompt) {
+    (void) info;
+    (void) finishedPrompt;
+
+    *done = true;
+}
+
+// Sender side.
+
+static void on_ack(void* data, uint32_t index, double latency) {
+    loopback_send* send = (loopback_send*) data;
+
+    send->latencies[index] = latency;
+    send->acked++;
+
+    if(send->verbose) {
+        printf("file %u: %.3f ms\n", index, latency * 1000.0);
+    }
+}
+
+static void* loopback_send_thread(void* arg) {
+    loopback_send* send = (loopback_send*) arg;
+
+    u8* contents = (u8*) malloc(send->size);
+    if(contents == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+
+        send->done = true;
+        return NULL;
+    }
+
+    u32 seed = 0x46424921;
+    for(u64 i = 0; i < send->size; i++) {
+        seed = seed * 1664525 + 1013904223;
+        contents[i] = send->random ? (u8) (seed >> 24) : (u8) ("FBI loopback "[i % 13] + ((i >> 12) & 0x7));
+    }
+
+    // A zeroed CIA header: not a ticket's leading 0x0100, and section sizes
+    // of zero keep FBI's NCCH probe at 0x100 inside the file.
+    memset(contents, 0, CIA_HEADER_SIZE);
+
+    sender s;
+    memset(&s, 0, sizeof(s));
+    s.onAck = on_ack;
+    s.data = send;
+
+    if(sender_open(&s, "127.0.0.1", LOOPBACK_PORT, send->count, send->version, send->flags) < 0) {
+        fprintf(stderr, "Failed to start session: %s\n", strerror(errno));
+    } else {
+        printf("Protocol v%u%s, window %u.\n", s.version, (s.flags & SENDER_FLAG_LZ4) ? ", LZ4" : "", s.window);
+
+        double start = sender_time();
+
+        u32 i = 0;
+        for(; i < send->count; i++) {
+            FILE* file = fmemopen(contents, send->size, "rb");
+            if(file == NULL) {
+                fprintf(stderr, "Failed to open file %u: %s\n", i, strerror(errno));
+                break;
+            }
+
+            int res = sender_send_file(&s, file, send->size);
+            fclose(file);
+
+            if(res < 0) {
+                fprintf(stderr, "Failed to send file %u: %s\n", i, strerror(errno));
+                break;
+            }
+        }
+
+        send->succeeded = i == send->count && sender_finish(&s) == 0;
+        send->elapsed = sender_time() - start;
+    }
+
+    sender_close(&s);
+    free(contents);
+
+    send->done = true;
+    return NULL;
+}
+
+static u64 loopback_parse_ms(const char* text) {
+    return (u64) (strtod(text, NULL) * 1000000.0);
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-1] [-z] [-r] [-v] [-n files] [-s KiB] [-b ms] [-f ms] [-w ms] [-m MiB/s]\n", name);
+    fprintf(stderr, "  -1  use the legacy per-file handshake\n");
+    fprintf(stderr, "  -z  compress file data with LZ4\n");
+    fprintf(stderr, "  -r  send incompressible data\n");
+    fprintf(stderr, "  -v  print each file's latency\n");
+    fprintf(stderr, "  -n  number of files (default 16)\n");
+    fprintf(stderr, "  -s  size of each file in KiB (default 1024)\n");
+    fprintf(stderr, "  -b  delay of each install's start (default 0)\n");
+    fprintf(stderr, "  -f  delay of each install's finish (default 0)\n");
+    fprintf(stderr, "  -w  delay of each install write (default 0)\n");
+    fprintf(stderr, "  -m  install write rate (default unlimited)\n");
+}
+
+int main(int argc, char** argv) {
+    loopback_send send;
+    memset(&send, 0, sizeof(send));
+    send.count = 16;
+    send.size = 1024 * 1024;
+    send.version = SENDER_VERSION;
+
+    int opt;
+    while((opt = getopt(argc, argv, "1zrvn:s:b:f:w:m:")) != -1) {
+        switch(opt) {
+            case '1':
+                send.version = 1;
+                break;
+            case 'z':
+                send.flags |= SENDER_FLAG_LZ4;
+                break;
+            case 'r':
+                send.random = true;
+                break;
+            case 'v':
+                send.verbose = true;
+                break;
+            case 'n':
+                send.count = (u32) strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                send.size = strtoull(optarg, NULL, 0) * 1024;
+                break;
+            case 'b':
+                sink.beginNs = loopback_parse_ms(optarg);
+                break;
+            case 'f':
+                sink.finishNs = loopback_parse_ms(optarg);
+                break;
+            case 'w':
+                sink.writeNs = loopback_parse_ms(optarg);
+                break;
+            case 'm':
+                sink.bytesPerSec = (u64) (strtod(optarg, NULL) * MIB);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(send.count == 0 || send.size == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if((send.latencies = (double*) calloc(send.count, sizeof(double))) == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+
+    // The receiver writes its closing ack to a sender that may be gone.
+    signal(SIGPIPE, SIG_IGN);
+
+    host_init(LOOPBACK_HEAP);
+    host_file_write = loopback_write;
+    host_file_close = loopback_close;
+
+    networkinstall_open();
+    if(viewCount == 0) {
+        return 1;
+    }
+
+    pthread_t sendThread;
+    if(pthread_create(&sendThread, NULL, loopback_send_thread, &send) != 0) {
+        fprintf(stderr, "Failed to start sender thread.\n");
+        return 1;
+    }
+
+    // Runs the UI until the session is over and FBI is back to waiting,
+    // then backs out of the network install screen.
+    float progress = 0;
+    char text[PROGRESS_TEXT_MAX];
+    while(viewCount > 0) {
+        if(send.done && viewCount == 1) {
+            keysDown = KEY_B;
+        }
+
+        loopback_view* view = views[viewCount - 1];
+        view->update(&view->view, view->view.data, &progress, text);
+
+        svcSleepThread(LOOPBACK_FRAME_NS);
+    }
+
+    pthread_join(sendThread, NULL);
+
+    if(!send.succeeded || failed) {
+        fprintf(stderr, "Install did not complete: %u of %u file(s) acknowledged.\n", send.acked, send.count);
+        return 1;
+    }
+
+    double minLatency = send.latencies[0];
+    double maxLatency = send.latencies[0];
+    double sumLatency = 0;
+    for(u32 i = 0; i < send.count; i++) {
+        minLatency = fmin(minLatency, send.latencies[i]);
+        maxLatency = fmax(maxLatency, send.latencies[i]);
+        sumLatency += send.latencies[i];
+    }
+
+    double total = send.count * (double) send.size;
+    printf("Installed %u file(s), %.2f MiB in %.3f s (%.3f MiB/s).\n", installCount, installed / MIB, send.elapsed, total / MIB / send.elapsed);
+    printf("Per-file latency: min %.3f ms, avg %.3f ms, max %.3f ms.\n", minLatency * 1000.0, sumLatency / send.count * 1000.0, maxLatency * 1000.0);
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sender.h"
+
+typedef struct {
+    char** names;
+    uint64_t* sizes;
+} send_info;
+
+static void on_ack(void* data, uint32_t index, double latency) {
+    send_info* info = (send_info*) data;
+
+    printf("%s: %.2f MiB in %.3f s (%.3f MiB/s)\n", info->names[index], info->sizes[index] / 1024.0 / 1024.0, latency,
+           latency > 0 ? info->sizes[index] / 1024.0 / 1024.0 / latency : 0);
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-1] [-z] [-p port] <3ds ip> <file>...\n", name);
+    fprintf(stderr, "  -1  use the legacy per-file handshake\n");
+    fprintf(stderr, "  -z  compress file data with LZ4 if FBI supports it\n");
+    fprintf(stderr, "  -p  port FBI is listening on (default %d)\n", SENDER_PORT);
+}
+
+int main(int argc, char** argv) {
+    uint32_t version = SENDER_VERSION;
+    uint32_t flags = 0;
+    uint16_t port = SENDER_PORT;
+
+    int opt;
+    while((opt = getopt(argc, argv, "1zp:")) != -1) {
+        switch(opt) {
+            case '1':
+                version = 1;
+                break;
+            case 'z':
+                flags |= SENDER_FLAG_LZ4;
+                break;
+            case 'p':
+                port = (uint16_t) atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(argc - optind < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char* host = argv[optind];
+    uint32_t count = (uint32_t) (argc - optind - 1);
+
+    send_info info;
+    info.names = &argv[optind + 1];
+    if((info.sizes = (uint64_t*) calloc(count, sizeof(uint64_t))) == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+
+    for(uint32_t i = 0; i < count; i++) {
+        struct stat st;
+        if(stat(info.names[i], &st) < 0 || !S_ISREG(st.st_mode)) {
+            fprintf(stderr, "%s: not a readable file\n", info.names[i]);
+
+            free(info.sizes);
+            return 1;
+        }
+
+        info.sizes[i] = (uint64_t) st.st_size;
+    }
+
+    sender s;
+    memset(&s, 0, sizeof(s));
+    s.onAck = on_ack;
+    s.data = &info;
+
+    int ret = 1;
+
+    printf("Connecting to %s:%u...\n", host, port);
+    if(sender_open(&s, host, port, count, version, flags) < 0) {
+        fprintf(stderr, "Failed to start session: %s\n", strerror(errno));
+    } else {
+        printf("Protocol v%u%s, window %u.\n", s.version, (s.flags & SENDER_FLAG_LZ4) ? ", LZ4" : "", s.window);
+
+        double start = sender_time();
+
+        uint64_t total = 0;
+        uint32_t i = 0;
+        for(; i < count; i++) {
+            FILE* file = fopen(info.names[i], "rb");
+            if(file == NULL) {
+                fprintf(stderr, "%s: %s\n", info.names[i], strerror(errno));
+                break;
+            }
+
+            int res = sender_send_file(&s, file, info.sizes[i]);
+            fclose(file);
+
+            if(res < 0) {
+                fprintf(stderr, "%s: failed to send: %s\n", info.names[i], strerror(errno));
+                break;
+            }
+
+            total += info.sizes[i];
+        }
+
+        if(i == count && sender_finish(&s) == 0) {
+            double elapsed = sender_time() - start;
+            printf("Installed %u file(s), %.2f MiB in %.3f s (%.3f MiB/s).\n", count, total / 1024.0 / 1024.0, elapsed,
+                   elapsed > 0 ? total / 1024.0 / 1024.0 / elapsed : 0);
+
+            ret = 0;
+        } else if(i == count) {
+            fprintf(stderr, "Install did not complete: %u of %u file(s) acknowledged.\n", s.acked, count);
+        }
+    }
+
+    sender_close(&s);
+    free(info.sizes);
+
+    return ret;
+}
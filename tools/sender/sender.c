@@ -0,0 +1,272 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "sender.h"
+#include "../../source/core/lz4.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+double sender_time() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int sender_send_all(sender* s, const void* buf, size_t len) {
+    size_t written = 0;
+    while(written < len) {
+        ssize_t ret = send(s->socket, (const uint8_t*) buf + written, len - written, MSG_NOSIGNAL);
+        if(ret < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            return -1;
+        }
+
+        written += ret;
+    }
+
+    return 0;
+}
+
+static int sender_recv_all(sender* s, void* buf, size_t len) {
+    size_t read = 0;
+    while(read < len) {
+        ssize_t ret = recv(s->socket, (uint8_t*) buf + read, len - read, 0);
+        if(ret <= 0) {
+            if(ret < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if(ret == 0) {
+                errno = ECONNRESET;
+            }
+
+            return -1;
+        }
+
+        read += ret;
+    }
+
+    return 0;
+}
+
+static void sender_put64(uint8_t* p, uint64_t value) {
+    for(int i = 0; i < 8; i++) {
+        p[i] = (uint8_t) (value >> (56 - i * 8));
+    }
+}
+
+// A 1 acks the oldest unacknowledged file; a 0 means FBI stopped the session.
+static int sender_wait_ack(sender* s) {
+    uint8_t ack = 0;
+    if(sender_recv_all(s, &ack, sizeof(ack)) < 0) {
+        return -1;
+    }
+
+    if(ack != 1) {
+        errno = ECANCELED;
+        return -1;
+    }
+
+    if(s->version >= 2) {
+        if(s->acked < s->sent) {
+            if(s->onAck != NULL) {
+                s->onAck(s->data, s->acked, sender_time() - s->startTimes[s->acked]);
+            }
+
+            s->acked++;
+        }
+    } else if(s->sent > 0) {
+        // v1 acks each file by asking for the next one.
+        if(s->onAck != NULL) {
+            s->onAck(s->data, s->sent - 1, sender_time() - s->startTimes[s->sent - 1]);
+        }
+
+        s->acked = s->sent;
+    }
+
+    return 0;
+}
+
+int sender_open(sender* s, const char* host, uint16_t port, uint32_t count, uint32_t version, uint32_t flags) {
+    void (*onAck)(void* data, uint32_t index, double latency) = s->onAck;
+    void* data = s->data;
+
+    memset(s, 0, sizeof(*s));
+    s->socket = -1;
+    s->onAck = onAck;
+    s->data = data;
+
+    s->count = count;
+    s->version = version >= 2 ? SENDER_VERSION : 1;
+    s->flags = s->version >= 2 ? flags : 0;
+    s->window = 1;
+
+    if((s->startTimes = (double*) calloc(count > 0 ? count : 1, sizeof(double))) == NULL
+       || (s->buffer = (uint8_t*) malloc(SENDER_FRAME_MAX)) == NULL
+       || (s->packed = (uint8_t*) malloc(LZ4_COMPRESS_BOUND(SENDER_FRAME_MAX))) == NULL
+       || (s->workspace = malloc(LZ4_WORKSPACE_SIZE)) == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* info = NULL;
+    if(getaddrinfo(host, service, &hints, &info) != 0) {
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+
+    s->socket = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    if(s->socket < 0 || connect(s->socket, info->ai_addr, info->ai_addrlen) < 0) {
+        freeaddrinfo(info);
+        return -1;
+    }
+
+    freeaddrinfo(info);
+
+    if(s->version < 2) {
+        uint32_t netCount = htonl(count);
+        return sender_send_all(s, &netCount, sizeof(netCount));
+    }
+
+    uint32_t hello[4] = {htonl(SENDER_MAGIC), htonl(s->version), htonl(s->flags), htonl(count)};
+    if(sender_send_all(s, hello, sizeof(hello)) < 0) {
+        return -1;
+    }
+
+    // A declined install is answered with a lone 0 and a closed connection.
+    uint32_t reply[4];
+    if(sender_recv_all(s, reply, sizeof(reply)) < 0 || ntohl(reply[0]) != SENDER_MAGIC) {
+        errno = ECANCELED;
+        return -1;
+    }
+
+    s->version = ntohl(reply[1]);
+    s->flags &= ntohl(reply[2]);
+    s->window = s->version >= 2 && ntohl(reply[3]) > 0 ? ntohl(reply[3]) : 1;
+
+    return 0;
+}
+
+static int sender_send_data(sender* s, FILE* file, uint64_t size) {
+    uint64_t offset = 0;
+    while(offset < size) {
+        uint32_t rawSize = size - offset < SENDER_FRAME_MAX ? (uint32_t) (size - offset) : SENDER_FRAME_MAX;
+        if(fread(s->buffer, 1, rawSize, file) != rawSize) {
+            errno = EIO;
+            return -1;
+        }
+
+        if(s->flags & SENDER_FLAG_LZ4) {
+            // Frames that do not shrink are sent stored, marked by equal sizes.
+            uint32_t packedSize = lz4_compress(s->buffer, rawSize, s->packed, rawSize - 1, s->workspace);
+            bool stored = packedSize == 0;
+
+            uint32_t header[2] = {htonl(rawSize), htonl(stored ? rawSize : packedSize)};
+            if(sender_send_all(s, header, sizeof(header)) < 0
+               || sender_send_all(s, stored ? s->buffer : s->packed, stored ? rawSize : packedSize) < 0) {
+                return -1;
+            }
+        } else if(sender_send_all(s, s->buffer, rawSize) < 0) {
+            return -1;
+        }
+
+        offset += rawSize;
+    }
+
+    return 0;
+}
+
+int sender_send_file(sender* s, FILE* file, uint64_t size) {
+    if(s->sent >= s->count) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(s->version < 2) {
+        if(sender_wait_ack(s) < 0) {
+            return -1;
+        }
+    } else {
+        while(s->sent - s->acked >= s->window) {
+            if(sender_wait_ack(s) < 0) {
+                return -1;
+            }
+        }
+    }
+
+    s->startTimes[s->sent] = sender_time();
+
+    uint8_t netSize[8];
+    sender_put64(netSize, size);
+    if(sender_send_all(s, netSize, sizeof(netSize)) < 0 || sender_send_data(s, file, size) < 0) {
+        return -1;
+    }
+
+    s->sent++;
+    return 0;
+}
+
+int sender_finish(sender* s) {
+    if(s->version < 2) {
+        // The closing 0 acks the last file.
+        uint8_t ack = 1;
+        if(sender_recv_all(s, &ack, sizeof(ack)) < 0 || ack != 0) {
+            return -1;
+        }
+
+        if(s->sent > 0) {
+            if(s->onAck != NULL) {
+                s->onAck(s->data, s->sent - 1, sender_time() - s->startTimes[s->sent - 1]);
+            }
+
+            s->acked = s->sent;
+        }
+    } else {
+        while(s->acked < s->sent) {
+            if(sender_wait_ack(s) < 0) {
+                return -1;
+            }
+        }
+    }
+
+    return s->acked == s->count ? 0 : -1;
+}
+
+void sender_close(sender* s) {
+    if(s->socket >= 0) {
+        close(s->socket);
+        s->socket = -1;
+    }
+
+    free(s->startTimes);
+    s->startTimes = NULL;
+
+    free(s->buffer);
+    s->buffer = NULL;
+
+    free(s->packed);
+    s->packed = NULL;
+
+    free(s->workspace);
+    s->workspace = NULL;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define SENDER_PORT 5000
+
+// Wire protocol of source/ui/section/networkinstall.c.
+#define SENDER_MAGIC 0x46424932
+#define SENDER_VERSION 2
+#define SENDER_FLAG_LZ4 0x1
+#define SENDER_FRAME_MAX (64 * 1024)
+
+typedef struct sender_s {
+    int socket;
+
+    uint32_t version;
+    uint32_t flags;
+    uint32_t window;
+
+    uint32_t count;
+    uint32_t sent;
+    uint32_t acked;
+
+    // Time each file started sending, for ack latency.
+    double* startTimes;
+
+    // Called as each file is acknowledged as installed.
+    void (*onAck)(void* data, uint32_t index, double latency);
+    void* data;
+
+    uint8_t* buffer;
+    uint8_t* packed;
+    void* workspace;
+} sender;
+
+double sender_time();
+
+// Connects and negotiates the protocol. version is 1 for the legacy per-file
+// handshake; 2 and flags are only used if FBI accepts them. Returns -1 with
+// errno set on failure, or if the install was declined.
+int sender_open(sender* s, const char* host, uint16_t port, uint32_t count, uint32_t version, uint32_t flags);
+
+// Sends the next file; size bytes are read from file.
+int sender_send_file(sender* s, FILE* file, uint64_t size);
+
+// Waits for the remaining acks. Returns -1 if not every file was installed.
+int sender_finish(sender* s);
+
+void sender_close(sender* s);